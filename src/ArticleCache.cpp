@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <zlib.h>
+
+#include "ArticleCache.h"
+
+namespace fs = std::filesystem;
+
+// Entry ids hold slashes and colons, so files are named after a hash of them.
+static std::string fileName(const std::string& id){
+        std::uint64_t hash = 14695981039346656037ULL;
+        for(const auto c : id){
+                hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        }
+
+        auto name = std::array<char, 17>{};
+        snprintf(name.data(), name.size(), "%016llx", static_cast<unsigned long long>(hash));
+        return name.data();
+}
+
+ArticleCache::ArticleCache(const fs::path& directory):
+        directory{directory}{
+        auto errorCode = std::error_code{};
+        for(const auto& entry : fs::directory_iterator(directory, errorCode)){
+                if(entry.is_regular_file() && (entry.path().extension() == ".gz")){
+                        files[entry.path()] = File{entry.last_write_time(), entry.file_size()};
+                        total += entry.file_size();
+                }
+        }
+}
+bool ArticleCache::contains(const std::string& id) const{
+        return files.count(pathOf(id)) > 0;
+}
+bool ArticleCache::evicted(const std::string& id) const{
+        return dropped.count(pathOf(id)) > 0;
+}
+// Written next to its final name first, so a copy is either complete or missing.
+void ArticleCache::store(const std::string& id, const std::string& html){
+        fs::create_directories(directory);
+
+        const auto path = pathOf(id);
+        auto partial = path;
+        partial += ".part";
+
+        const auto file = gzopen(partial.c_str(), "wb");
+        if(file == NULL){
+                throw std::runtime_error("Failed to create " + partial.native());
+        }
+
+        const auto written = html.empty() || (gzwrite(file, html.data(), html.size()) == static_cast<int>(html.size()));
+        if((gzclose(file) != Z_OK) || !written){
+                fs::remove(partial);
+                throw std::runtime_error("Failed to write " + partial.native());
+        }
+
+        fs::rename(partial, path);
+        auto& stored = files[path];
+        total -= stored.size;
+        stored = File{fs::last_write_time(path), fs::file_size(path)};
+        total += stored.size;
+        dropped.erase(path);
+        trim();
+}
+// The base element makes relative links and images point to the original site.
+fs::path ArticleCache::extract(const std::string& id, const std::string& url, const fs::path& directory){
+        const auto path = pathOf(id);
+        const auto file = gzopen(path.c_str(), "rb");
+        if(file == NULL){
+                remove(id);
+                throw std::runtime_error("The article isn't stored locally");
+        }
+
+        const auto target = directory / (fileName(id) + ".html");
+        auto out = std::ofstream(target, std::ofstream::binary);
+
+        auto base = url;
+        for(auto quote = base.find('"'); quote != std::string::npos; quote = base.find('"', quote)){
+                base.replace(quote, 1, "&quot;");
+        }
+
+        out << "<base href=\"" << base << "\">\n";
+
+        auto buffer = std::array<char, 64 * 1024>{};
+        int read;
+        while((read = gzread(file, buffer.data(), buffer.size())) > 0){
+                out.write(buffer.data(), read);
+        }
+
+        gzclose(file);
+        if((read < 0) || !out){
+                throw std::runtime_error("Failed to read the local copy of the article");
+        }
+
+        // Opening an article counts as using it, see trim().
+        const auto now = fs::file_time_type::clock::now();
+        auto errorCode = std::error_code{};
+        fs::last_write_time(path, now, errorCode);
+        if(const auto file = files.find(path); file != files.end()){
+                file->second.used = now;
+        }
+
+        return target;
+}
+void ArticleCache::remove(const std::string& id){
+        const auto path = pathOf(id);
+        auto errorCode = std::error_code{};
+        fs::remove(path, errorCode);
+        if(const auto file = files.find(path); file != files.end()){
+                total -= file->second.size;
+                files.erase(file);
+        }
+}
+fs::path ArticleCache::pathOf(const std::string& id) const{
+        return directory / (fileName(id) + ".html.gz");
+}
+// Drop the least recently used files until the rest fits in the budget.
+void ArticleCache::trim(){
+        if(total <= ARTICLE_CACHE_MAX_BYTES){
+                return;
+        }
+
+        auto byUse = std::vector<std::pair<fs::file_time_type, fs::path>>{};
+        for(const auto& [path, file] : files){
+                byUse.emplace_back(file.used, path);
+        }
+
+        std::sort(byUse.begin(), byUse.end());
+        for(auto it = byUse.begin(); (total > ARTICLE_CACHE_MAX_BYTES) && (it != byUse.end()); ++it){
+                auto errorCode = std::error_code{};
+                if(fs::remove(it->second, errorCode)){
+                        total -= files[it->second].size;
+                        files.erase(it->second);
+                        dropped.insert(it->second);
+                }
+        }
+}
@@ -0,0 +1,40 @@
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+
+#ifndef _ARTICLE_CACHE_H_
+#define _ARTICLE_CACHE_H_
+
+#define ARTICLE_CACHE_MAX_BYTES (64 * 1024 * 1024)
+
+// Local copies of the full articles of saved posts, gzip-compressed, one
+// file per entry. Once the files take more than ARTICLE_CACHE_MAX_BYTES
+// the least recently opened ones are dropped. The directory is listed once
+// and the sizes are kept up to date from then on.
+class ArticleCache{
+        public:
+                explicit ArticleCache(const std::filesystem::path& directory);
+                bool contains(const std::string& id) const;
+                // Dropped to stay within the budget since the cache was created;
+                // downloading it again would only drop another article.
+                bool evicted(const std::string& id) const;
+                // Both throw when the cache directory can't be written.
+                void store(const std::string& id, const std::string& html);
+                // Write the article to a plain HTML file in directory for a browser to open.
+                std::filesystem::path extract(const std::string& id, const std::string& url, const std::filesystem::path& directory);
+                void remove(const std::string& id);
+        private:
+                struct File{
+                        std::filesystem::file_time_type used;
+                        std::uintmax_t size{};
+                };
+                std::filesystem::path directory;
+                std::map<std::filesystem::path, File> files;
+                std::uintmax_t total{};
+                std::set<std::filesystem::path> dropped;
+                std::filesystem::path pathOf(const std::string& id) const;
+                void trim();
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdexcept>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/signalfd.h>
+#endif
+
+#include "ChildReaper.h"
+
+extern char** environ;
+
+#ifndef __linux__
+static int notifyFd = -1;
+
+static void notifyChildExit(int){
+        const auto savedErrno = errno;
+        const char byte = 0;
+        [[maybe_unused]] const auto written = write(notifyFd, &byte, 1);
+        errno = savedErrno;
+}
+#endif
+
+ChildReaper::ChildReaper(){
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        pthread_sigmask(SIG_BLOCK, &mask, &previousMask);
+
+#ifdef __linux__
+        readFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if(readFd == -1){
+                throw std::runtime_error(std::string("Failed to create a signalfd: ") + strerror(errno));
+        }
+#else
+        int fds[2];
+        if(pipe(fds) == -1){
+                throw std::runtime_error(std::string("Failed to create a pipe: ") + strerror(errno));
+        }
+
+        readFd = fds[0];
+        writeFd = fds[1];
+        for(const auto fd : fds){
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+
+        notifyFd = writeFd;
+        struct sigaction action{};
+        action.sa_handler = notifyChildExit;
+        action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+        sigaction(SIGCHLD, &action, NULL);
+        pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
+#endif
+}
+ChildReaper::~ChildReaper(){
+#ifndef __linux__
+        signal(SIGCHLD, SIG_DFL);
+        notifyFd = -1;
+        close(writeFd);
+#endif
+        close(readFd);
+        pthread_sigmask(SIG_SETMASK, &previousMask, NULL);
+}
+pid_t ChildReaper::spawn(const std::string& command, const std::string& arg){
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+
+        // A GUI browser may print anything; keep it off the curses screen.
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+        posix_spawnattr_t attributes;
+        posix_spawnattr_init(&attributes);
+
+        sigset_t noSignals;
+        sigemptyset(&noSignals);
+        posix_spawnattr_setsigmask(&attributes, &noSignals);
+
+        short flags = POSIX_SPAWN_SETSIGMASK;
+#ifdef POSIX_SPAWN_SETSID
+        // Leave the terminal's session so Ctrl-C in feednix doesn't close the browser.
+        flags |= POSIX_SPAWN_SETSID;
+#endif
+        posix_spawnattr_setflags(&attributes, flags);
+
+        auto argv = std::vector<char*>{const_cast<char*>(command.c_str()), const_cast<char*>(arg.c_str()), NULL};
+        pid_t pid;
+        const auto result = posix_spawnp(&pid, command.c_str(), &actions, &attributes, argv.data(), environ);
+
+        posix_spawnattr_destroy(&attributes);
+        posix_spawn_file_actions_destroy(&actions);
+
+        if(result != 0){
+                throw std::runtime_error("Failed to execute '" + command + "': " + strerror(result));
+        }
+
+        children[pid] = command;
+        return pid;
+}
+std::vector<ExitedChild> ChildReaper::reap(){
+        // Signals coalesce, so the notifications only say that some child exited.
+#ifdef __linux__
+        signalfd_siginfo info;
+        while(read(readFd, &info, sizeof(info)) == sizeof(info)){
+        }
+#else
+        char buffer[64];
+        while(read(readFd, buffer, sizeof(buffer)) > 0){
+        }
+#endif
+
+        auto exited = std::vector<ExitedChild>{};
+        for(auto it = children.begin(); it != children.end();){
+                int status;
+                if(waitpid(it->first, &status, WNOHANG) > 0){
+                        exited.push_back({it->first, it->second, status});
+                        it = children.erase(it);
+                }
+                else{
+                        ++it;
+                }
+        }
+
+        return exited;
+}
+// For processes started with fork(), which inherit the blocked SIGCHLD.
+void ChildReaper::resetSignalMask(){
+        sigset_t noSignals;
+        sigemptyset(&noSignals);
+        pthread_sigmask(SIG_SETMASK, &noSignals, NULL);
+}
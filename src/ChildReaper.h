@@ -0,0 +1,45 @@
+#include <map>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+#include <sys/types.h>
+
+#ifndef _CHILD_REAPER_H_
+#define _CHILD_REAPER_H_
+
+struct ExitedChild{
+        pid_t pid;
+        std::string command;
+        int status;
+};
+
+// Starts programs in the background and collects them when they exit.
+// SIGCHLD is turned into a readable descriptor (a signalfd on Linux,
+// a self-pipe elsewhere) that can be polled by the event loop.
+//
+// SIGCHLD is blocked in the constructing thread, so construct this
+// before any other thread is started.
+class ChildReaper{
+        public:
+                ChildReaper();
+                ChildReaper(const ChildReaper&) = delete;
+                ChildReaper& operator=(const ChildReaper&) = delete;
+                ~ChildReaper();
+                int fd() const{
+                        return readFd;
+                }
+                // Start command detached from the terminal. Throws if it can't be run.
+                pid_t spawn(const std::string& command, const std::string& arg);
+                // Collect the children started by spawn() that have exited.
+                // Other children are left for whoever waits for them.
+                std::vector<ExitedChild> reap();
+                static void resetSignalMask();
+        private:
+                int readFd{-1};
+                int writeFd{-1};
+                sigset_t previousMask;
+                std::map<pid_t, std::string> children;
+};
+
+#endif
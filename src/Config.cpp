@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "Config.h"
+
+namespace fs = std::filesystem;
+
+Config Config::load(const fs::path& path){
+        std::ifstream file(path, std::ifstream::binary);
+        if(!file){
+                throw std::runtime_error("Unable to open " + path.native());
+        }
+
+        // The builder's defaults accept the comments used in config.json.
+        Json::CharReaderBuilder builder;
+        Json::Value root;
+        std::string errors;
+        if(!Json::parseFromStream(builder, file, &root, &errors)){
+                throw std::runtime_error(errors);
+        }
+
+        auto config = Config{};
+        const auto& colors = root["colors"];
+        config.colors.background = colors["background"].asInt();
+        config.colors.activePanel = colors["active_panel"].asInt();
+        config.colors.idlePanel = colors["idle_panel"].asInt();
+        config.colors.counter = colors["counter"].asInt();
+        config.colors.statusLine = colors["status_line"].asInt();
+        config.colors.instructionsLine = colors["instructions_line"].asInt();
+        config.colors.itemText = colors["item_text"].asInt();
+        config.colors.itemHighlight = colors["item_highlight"].asInt();
+        config.colors.readItem = colors["read_item"].asInt();
+
+        config.ctgWinWidth = root["ctg_win_width"].asInt();
+        config.viewWinHeight = root["view_win_height"].asInt();
+        config.viewWinHeightPer = root["view_win_height_per"].asInt();
+
+        // The sample config has always stored the count as a string.
+        const auto& count = root["posts_retrive_count"];
+        try{
+                if(count.isString()){
+                        config.postsRetrieveCount = std::stoul(count.asString());
+                }
+                else if(count.isIntegral()){
+                        config.postsRetrieveCount = count.asUInt();
+                }
+        }
+        catch(const std::exception&){
+                throw std::runtime_error("posts_retrive_count is not a number");
+        }
+
+        config.rank = root["rank"].asBool();
+        config.lazyContent = root["lazy_content"].asBool();
+        for(const auto& labels : root["merged_categories"]){
+                if(!labels.isArray()){
+                        throw std::runtime_error("merged_categories is not a list of lists of category names");
+                }
+
+                auto categories = std::vector<std::string>{};
+                for(const auto& label : labels){
+                        categories.push_back(label.asString());
+                }
+
+                config.mergedCategories.push_back(std::move(categories));
+        }
+
+        config.hedgePercentile = std::min(root["hedge_percentile"].asUInt(), 99U);
+        config.secondsToMarkAsRead = std::chrono::seconds(root["seconds_to_mark_as_read"].asInt());
+        config.textBrowser = root["text_browser"].asString();
+
+        config.hasDeveloperToken = !root["developer_token"].isNull();
+        config.developerToken = root["developer_token"].asString();
+        config.userId = root["userID"].asString();
+        config.document = std::move(root);
+        return config;
+}
+void Config::setCredentials(const std::string& userId, const std::string& developerToken){
+        this->userId = userId;
+        this->developerToken = developerToken;
+        hasDeveloperToken = true;
+        document["userID"] = userId;
+        document["developer_token"] = developerToken;
+}
+void Config::save(const fs::path& path) const{
+        std::ofstream file(path);
+        file << document;
+}
+
+ConfigWatcher::ConfigWatcher(const fs::path& path):
+        fileName{path.filename()}{
+#ifdef __linux__
+        // Watch the directory: editors often save by renaming a new file over the old one.
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(inotifyFd != -1){
+                if(inotify_add_watch(inotifyFd, path.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1){
+                        close(inotifyFd);
+                        inotifyFd = -1;
+                }
+        }
+#endif
+}
+ConfigWatcher::~ConfigWatcher(){
+        if(inotifyFd != -1){
+                close(inotifyFd);
+        }
+}
+bool ConfigWatcher::changed(){
+        auto changed = false;
+#ifdef __linux__
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while((inotifyFd != -1) && ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)){
+                for(auto offset = ssize_t{0}; offset < length;){
+                        const auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                        if((event->len > 0) && (fileName == event->name)){
+                                changed = true;
+                        }
+
+                        offset += sizeof(inotify_event) + event->len;
+                }
+        }
+#endif
+        return changed;
+}
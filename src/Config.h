@@ -0,0 +1,73 @@
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#define DEFAULT_POSTS_RETRIEVE_COUNT 20
+
+// Color numbers of the curses color pairs, see the "colors" section of config.json.
+struct ColorConfig{
+        int background{};
+        int activePanel{};
+        int idlePanel{};
+        int counter{};
+        int statusLine{};
+        int instructionsLine{};
+        int itemText{};
+        int itemHighlight{};
+        int readItem{};
+};
+
+// The contents of config.json. Zero sizes mean "use the default".
+struct Config{
+        ColorConfig colors;
+        int ctgWinWidth{};
+        int viewWinHeight{};
+        int viewWinHeightPer{};
+        unsigned int postsRetrieveCount{DEFAULT_POSTS_RETRIEVE_COUNT};
+        bool rank{};
+        // Fetch entry ids first and their content only when they're listed.
+        bool lazyContent{};
+        // Sets of category labels, each listed as one more category.
+        std::vector<std::vector<std::string>> mergedCategories;
+        // Send a second copy of a GET still unanswered at this percentile of
+        // the endpoint's latency; 0 disables hedging.
+        unsigned int hedgePercentile{};
+        std::chrono::seconds secondsToMarkAsRead{};
+        std::string textBrowser;
+        bool hasDeveloperToken{};
+        std::string developerToken;
+        std::string userId;
+        // Keeps unknown keys when the file is written back.
+        Json::Value document;
+
+        // Throws with the parser's messages if the file can't be read.
+        static Config load(const std::filesystem::path& path);
+        void setCredentials(const std::string& userId, const std::string& developerToken);
+        void save(const std::filesystem::path& path) const;
+};
+
+// Reports changes to a file, including editors replacing it with a new one.
+// fd() becomes readable on a change; it is -1 where inotify is unavailable.
+class ConfigWatcher{
+        public:
+                explicit ConfigWatcher(const std::filesystem::path& path);
+                ConfigWatcher(const ConfigWatcher&) = delete;
+                ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+                ~ConfigWatcher();
+                int fd() const{
+                        return inotifyFd;
+                }
+                // Drain the pending events and tell whether the file was among them.
+                bool changed();
+        private:
+                std::string fileName;
+                int inotifyFd{-1};
+};
+
+#endif
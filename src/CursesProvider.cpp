@@ -12,7 +12,6 @@
 #include <iterator>
 #include <algorithm>
 #include <string.h>
-#include <termios.h>
 #include <unistd.h>
 #include <signal.h>
 #include <json/json.h>
@@ -20,9 +19,11 @@
 #include <sys/wait.h>
 
 #include "CursesProvider.h"
+#include "Logger.h"
+#include "Tracer.h"
 
-#define POSTS_STATUSLINE "Enter: See Preview  A: mark all read  u: mark unread  r: mark read  = : change sort type s: mark saved  S: mark unsaved R: refresh  o: Open in plain-text  O: Open in Browser  F1: exit"
-#define CTG_STATUSLINE "Enter: Fetch Stream  A: mark all read  R: refresh  F1: exit"
+#define POSTS_STATUSLINE "Enter: See Preview  A: mark all read  u: mark unread  r: mark read  v: select range  t: tag  = : change sort type s: mark saved  S: mark unsaved R: refresh  o: Open in plain-text  O: Open in Browser  N: network stats  F: feed stats  F1: exit"
+#define CTG_STATUSLINE "Enter: Fetch Stream  l/h: show/hide feeds  A: mark all read  R: refresh  N: network stats  F: feed stats  F1: exit"
 
 #define HOME_PATH getenv("HOME")
 
@@ -37,13 +38,21 @@ static void throwIfError(int result, const std::string& action){
 }
 
 CursesProvider::CursesProvider(const fs::path& tmpPath, bool verbose, bool change):
-        feedly{FeedlyProvider(tmpPath)},
+        articles{fs::path{HOME_PATH} / ".cache" / "feednix" / "articles"},
+        analytics{fs::path{HOME_PATH} / ".local" / "share" / "feednix" / "feeds.json"},
         previewPath{tmpPath / "preview.html"}{
 
         feedly.setVerbose(verbose);
         feedly.setChangeTokensFlag(change);
         feedly.authenticateUser();
 
+        try{
+                analytics.load();
+        }
+        catch(const std::exception& e){
+                Logger::warning(e.what());
+        }
+
         setlocale(LC_ALL, "");
         initscr();
 
@@ -53,64 +62,775 @@ CursesProvider::CursesProvider(const fs::path& tmpPath, bool verbose, bool chang
         keypad(stdscr, TRUE);
         curs_set(0);
 
+        // Reading keys from stdscr would refresh it behind the frame scheduler's back.
+        inputPad = newpad(1, 1);
+        keypad(inputPad, TRUE);
+        nodelay(inputPad, TRUE);
+
         feedly.setVerbose(false);
 }
 void CursesProvider::init(){
-        Json::Value root;
-        Json::Reader reader;
+        const auto config = feedly.getConfig();
+        currentRank = config->rank;
+        sortMode = currentRank ? SortMode::OLDEST : SortMode::NEWEST;
+        applyConfig(*config);
+
+        // Only the global streams are known until the categories arrive.
+        labels = feedly.getCachedLabels();
+        subscriptions = feedly.getCachedSubscriptions();
+
+        createCategoriesMenu();
+        createPostsMenu();
+        layoutWindows();
+
+        printPostMenuMessage("Loading...");
+
+        // None of these depend on each other, so they go out together and
+        // their connection is set up while the first frame is drawn.
+        fetchLabels();
+        fetchSubscriptions();
+        ctgMenuCallback("All", true);
+        refreshUnreadCounts();
+        feedly.processEvents();
+
+        drawFrame();
+        logStartupTime("time_to_first_paint_ms");
+}
+void CursesProvider::fetchLabels(){
+        labelsRequest = feedly.requestLabels([this](std::shared_ptr<const Categories> newLabels, const std::string& error){
+                labelsRequest = 0;
+                if(error.empty()){
+                        labels = std::move(newLabels);
+                        fillCategoryItems();
+                        prefetchCategories();
+                }
+                else{
+                        update_statusline(error.c_str(), NULL, false);
+                }
+
+                reportInteractive();
+        });
+}
+// Startup is complete once the categories and the first stream have been shown.
+void CursesProvider::reportInteractive(){
+        if(!startupReported && (labelsRequest == 0) && (streamRequest == 0)){
+                startupReported = true;
+                logStartupTime("time_to_interactive_ms");
+        }
+}
+void CursesProvider::logStartupTime(const char* metric){
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+        Logger::info("startup "s + metric + "=" + std::to_string(elapsed.count()));
+}
+// Take over the settings that can change while feednix is running.
+void CursesProvider::applyConfig(const Config& config){
+        const auto& colors = config.colors;
+        init_pair(1, colors.activePanel, colors.background);
+        init_pair(2, colors.idlePanel, colors.background);
+        init_pair(3, colors.counter, colors.background);
+        init_pair(4, colors.statusLine, colors.background);
+        init_pair(5, colors.instructionsLine, colors.background);
+        init_pair(6, colors.itemText, colors.background);
+        init_pair(7, colors.itemHighlight, colors.background);
+        init_pair(8, colors.readItem, colors.background);
+
+        ctgWinWidth = (config.ctgWinWidth != 0) ? config.ctgWinWidth : CTG_WIN_WIDTH;
+        viewWinHeight = config.viewWinHeight;
+        viewWinHeightPer = config.viewWinHeightPer;
+        secondsToMarkAsRead = config.secondsToMarkAsRead;
 
         if(const auto browserEnv = getenv("BROWSER")){
                 textBrowser = browserEnv;
         }
+        else if(!config.textBrowser.empty()){
+                textBrowser = config.textBrowser;
+        }
+        else{
+                textBrowser = "w3m";
+        }
+
+        if(textBrowser.at(0) == '~'){
+                textBrowser.replace(0, 1, getenv("HOME"));
+        }
+
+        mergedViews.clear();
+        for(const auto& categories : config.mergedCategories){
+                auto label = std::string{};
+                for(const auto& category : categories){
+                        label += (label.empty() ? "" : " + ") + category;
+                }
+
+                if(categories.size() > 1){
+                        mergedViews[label] = categories;
+                }
+        }
+}
+void CursesProvider::reloadConfig(){
+        const auto previous = feedly.getConfig();
+        try{
+                const auto config = feedly.reloadConfig();
+                applyConfig(*config);
+                fillCategoryItems();
+
+                if((config->ctgWinWidth != previous->ctgWinWidth) ||
+                    (config->viewWinHeight != previous->viewWinHeight) ||
+                    (config->viewWinHeightPer != previous->viewWinHeightPer)){
+                        layoutWindows();
+                }
+
+                // Redefined color pairs take effect on the next frame.
+                update_statusline("[Config reloaded]", NULL, totalPosts > 0);
+                frames.markDirty(FRAME_WINDOWS);
+        }
+        catch(const std::exception& e){
+                auto message = "Config not reloaded: "s + e.what();
+                std::replace(message.begin(), message.end(), '\n', ' ');
+                update_statusline(message.c_str(), NULL, false);
+        }
+}
+void CursesProvider::control(){
+        set_escdelay(ESC_DELAY_MS);
+
+        auto fds = std::vector<curl_waitfd>{
+                {STDIN_FILENO, CURL_WAIT_POLLIN, 0},
+                {children.fd(), CURL_WAIT_POLLIN, 0},
+                {configWatcher.fd(), CURL_WAIT_POLLIN, 0}};
+        auto quit = false;
+        looping = 1;
+        while(!quit){
+                if(feedly.processEvents() > 0){
+                        frames.markDirty(FRAME_WINDOWS | FRAME_OVERLAY);
+                }
+
+                reapChildren();
+
+                if(configWatcher.changed()){
+                        reloadConfig();
+                }
 
-        std::ifstream tokenFile(std::string(std::string(HOME_PATH) + "/.config/feednix/config.json").c_str(), std::ifstream::binary);
-        if(reader.parse(tokenFile, root)){
-                init_pair(1, root["colors"]["active_panel"].asInt(), root["colors"]["background"].asInt());
-                init_pair(2, root["colors"]["idle_panel"].asInt(), root["colors"]["background"].asInt());
-                init_pair(3, root["colors"]["counter"].asInt(), root["colors"]["background"].asInt());
-                init_pair(4, root["colors"]["status_line"].asInt(), root["colors"]["background"].asInt());
-                init_pair(5, root["colors"]["instructions_line"].asInt(), root["colors"]["background"].asInt());
-                init_pair(6, root["colors"]["item_text"].asInt(), root["colors"]["background"].asInt());
-                init_pair(7, root["colors"]["item_highlight"].asInt(), root["colors"]["background"].asInt());
-                init_pair(8, root["colors"]["read_item"].asInt(), root["colors"]["background"].asInt());
+                runTimers();
 
-                ctgWinWidth = root["ctg_win_width"].asInt();
-                viewWinHeight = root["view_win_height"].asInt();
-                viewWinHeightPer = root["view_win_height_per"].asInt();
+                // Handle every pending key before drawing, so a burst of
+                // repeated keys costs a single frame.
+                int ch;
+                while((ch = wgetch(inputPad)) != ERR){
+                        if((ch == KEY_F(1)) || (ch == 'q')){
+                                quit = true;
+                                break;
+                        }
 
-                currentRank = root["rank"].asBool();
-                secondsToMarkAsRead = std::chrono::seconds(root["seconds_to_mark_as_read"].asInt());
+                        handleKey(ch);
+                        poller.recordInput(std::chrono::steady_clock::now());
+                        frames.markDirty(FRAME_WINDOWS);
+                }
 
-                if(textBrowser.empty()){
-                        textBrowser = root["text_browser"].asString();
+                if(quit || stopRequested){
+                        break;
                 }
+
+                if(frames.frameDue()){
+                        drawFrame();
+                }
+
+                feedly.waitForEvents(fds, frames.timeoutMs(EVENT_LOOP_TIMEOUT_MS));
+        }
+
+        feedly.cancelRequest(streamRequest);
+        feedly.cancelRequest(countsRequest);
+        for(const auto& [label, id] : newPostsRequests){
+                feedly.cancelRequest(id);
+        }
+
+        feedly.cancelRequest(labelsRequest);
+        feedly.cancelRequest(subscriptionsRequest);
+        closeMergedView();
+        cancelPrefetches();
+        cancelEntryRequests();
+        cancelArticleDownloads();
+        markItemReadAutomatically(current_item(postsMenu));
+
+        try{
+                feedly.getRelevance().save();
+                analytics.save();
+        }
+        catch(const std::exception& e){
+                Logger::warning("Could not save the reading history: "s + e.what());
+        }
+
+        // Let outstanding markers reach the server before exiting, unless
+        // SIGINT or SIGTERM comes again meanwhile.
+        stopRequested = 0;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(EXIT_FLUSH_SECONDS);
+        auto noFds = std::vector<curl_waitfd>{};
+        while(feedly.hasPendingRequests() && (std::chrono::steady_clock::now() < deadline) && !stopRequested){
+                feedly.waitForEvents(noFds, EVENT_LOOP_TIMEOUT_MS);
+                feedly.processEvents();
+        }
+
+        looping = 0;
+}
+void CursesProvider::handleKey(int ch){
+        auto curItem = current_item(curMenu);
+        switch(ch){
+                case 10:
+                        if((curMenu == ctgMenu) && (curItem != NULL)){
+                                ctgMenuCallback(categoryLabel(curItem).c_str(), true);
+                        }
+                        else if((curMenu == postsMenu) && (curItem != NULL)){
+                                postsMenuCallback(curItem, true);
+                        }
+
+                        break;
+                case 27:
+                        if(!taggedPosts.empty() || !visualAnchor.empty()){
+                                clearSelection();
+                                update_statusline("[Selection cleared]", NULL, true);
+                        }
+                        else if((streamRequest != 0) || !pageRequests.empty()){
+                                feedly.cancelRequest(streamRequest);
+                                streamRequest = 0;
+                                for(const auto& [source, request] : pageRequests){
+                                        feedly.cancelRequest(request);
+                                }
+
+                                pageRequests.clear();
+                                update_statusline("[Cancelled]", NULL, totalPosts > 0);
+                        }
+
+                        break;
+                case 9:
+                        focusMenu((curMenu == ctgMenu) ? postsMenu : ctgMenu);
+                        break;
+                case KEY_RESIZE:
+                        resizeWindows();
+                        break;
+                case '=':
+                        if((statsPanel != NULL) && showFeedStats){
+                                static const std::map<FeedColumn, std::pair<FeedColumn, const char*>> nextColumns{
+                                        {FeedColumn::INGESTED, {FeedColumn::READ_RATE, "[Feeds sorted: least read first]"}},
+                                        {FeedColumn::READ_RATE, {FeedColumn::OPENED, "[Feeds sorted: by posts opened]"}},
+                                        {FeedColumn::OPENED, {FeedColumn::UNOPENED, "[Feeds sorted: by posts read unopened]"}},
+                                        {FeedColumn::UNOPENED, {FeedColumn::SAVED, "[Feeds sorted: by posts saved]"}},
+                                        {FeedColumn::SAVED, {FeedColumn::PREVIEW, "[Feeds sorted: by preview time]"}},
+                                        {FeedColumn::PREVIEW, {FeedColumn::INGESTED, "[Feeds sorted: by posts]"}}};
+                                const auto& [column, message] = nextColumns.at(feedColumn);
+                                feedColumn = column;
+                                update_statusline(message, NULL, false);
+                                frames.markDirty(FRAME_OVERLAY);
+                        }
+                        else{
+                                // The loaded posts are reordered locally; nothing is fetched.
+                                static const std::map<SortMode, std::pair<SortMode, const char*>> nextModes{
+                                        {SortMode::NEWEST, {SortMode::OLDEST, "[Sorted: oldest first]"}},
+                                        {SortMode::OLDEST, {SortMode::FEED, "[Sorted: by feed]"}},
+                                        {SortMode::FEED, {SortMode::ENGAGEMENT, "[Sorted: by engagement]"}},
+                                        {SortMode::ENGAGEMENT, {SortMode::RANKED, "[Sorted: by relevance]"}},
+                                        {SortMode::RANKED, {SortMode::NEWEST, "[Sorted: newest first]"}}};
+                                const auto& [mode, message] = nextModes.at(sortMode);
+                                sortMode = mode;
+
+                                const auto selectedItem = current_item(postsMenu);
+                                const auto selectedId = (selectedItem != NULL) ? postAt(selectedItem).id : std::string{};
+                                sortPosts();
+                                listPosts(selectedId);
+                                update_statusline(message, NULL, true);
+                        }
+
+                        break;
+                case KEY_DOWN:
+                        changeSelectedItem(curMenu, REQ_DOWN_ITEM);
+                        break;
+                case KEY_UP:
+                        changeSelectedItem(curMenu, REQ_UP_ITEM);
+                        break;
+                case 'j':
+                        changeSelectedItem(curMenu, REQ_DOWN_ITEM);
+                        break;
+                case KEY_RIGHT:
+                case 'l':
+                        if((curMenu == ctgMenu) && (curItem != NULL)){
+                                expandCategory(curItem, true);
+                        }
+
+                        break;
+                case KEY_LEFT:
+                case 'h':
+                        if((curMenu == ctgMenu) && (curItem != NULL)){
+                                expandCategory(curItem, false);
+                        }
+
+                        break;
+                case 'k':
+                        changeSelectedItem(curMenu, REQ_UP_ITEM);
+                        break;
+                case 'u':
+                        if((curMenu == postsMenu) && (curItem != NULL)){
+                                markSelectionRead(false);
+                        }
+
+                        break;
+                case 'r':
+                        if((curMenu == postsMenu) && (curItem != NULL)){
+                                markSelectionRead(true);
+                        }
+
+                        break;
+                case 's':
+                        if((curMenu == postsMenu) && (curItem != NULL)){
+                                markSelectionSaved(true);
+                        }
+
+                        break;
+                case 'S':
+                        if((curMenu == postsMenu) && (curItem != NULL)){
+                                markSelectionSaved(false);
+                        }
+
+                        break;
+                case 't':
+                        if((curMenu == postsMenu) && (curItem != NULL)){
+                                const auto& id = postAt(curItem).id;
+                                if(taggedPosts.erase(id) == 0){
+                                        taggedPosts.insert(id);
+                                }
+
+                                changeSelectedItem(postsMenu, REQ_DOWN_ITEM);
+                                reportSelection();
+                        }
+
+                        break;
+                case 'v':
+                        // Leaving the range mode keeps the range tagged, so ranges add up.
+                        if((curMenu == postsMenu) && (curItem != NULL)){
+                                if(visualAnchor.empty()){
+                                        visualAnchor = postAt(curItem).id;
+                                }
+                                else{
+                                        for(const auto& post : selectedPosts()){
+                                                taggedPosts.insert(post.id);
+                                        }
+
+                                        visualAnchor.clear();
+                                }
+
+                                reportSelection();
+                        }
+
+                        break;
+                case 'R':
+                        if(auto currentCategoryItem = current_item(ctgMenu)){
+                                werase(viewWin);
+                                ctgMenuCallback(categoryLabel(currentCategoryItem).c_str(), false);
+                                prefetchCategories();
+                        }
+
+                        break;
+                case 'o':
+                        if((curMenu == postsMenu) && (curItem != NULL)){
+                                postsMenuCallback(curItem, false);
+                        }
+
+                        break;
+                case 'O':
+                        if((curMenu == postsMenu) && (curItem != NULL)){
+                                // A GUI browser runs alongside feednix; reapChildren() collects it.
+                                try{
+                                        const auto& data = postAt(curItem);
+                                        if(!data.complete){
+                                                throw std::runtime_error("The post is still loading");
+                                        }
+
+#ifdef __APPLE__
+                                        children.spawn("open", articleLocation(data));
+#else
+                                        children.spawn("xdg-open", articleLocation(data));
+#endif
+                                        feedly.getRelevance().learn(data, Reaction::OPENED);
+                                        analytics.recordOpened(data);
+                                        markItemRead(curItem, true);
+                                }
+                                catch(const std::exception& e){
+                                        update_statusline(e.what(), NULL /*post*/, false /*showCounter*/);
+                                }
+                        }
+
+                        break;
+                case 'a':
+                        {
+                                char feed[200];
+                                char title[200];
+                                char ctg[200];
+                                echo();
+
+                                clear_statusline();
+                                attron(COLOR_PAIR(4));
+                                mvprintw(LINES - 2, 0, "[ENTER FEED]:");
+                                mvgetnstr(LINES-2, strlen("[ENTER FEED]") + 1, feed, 200);
+                                mvaddch(LINES-2, 0, ':');
+
+                                clrtoeol();
+
+                                mvprintw(LINES - 2, 0, "[ENTER TITLE]:");
+                                mvgetnstr(LINES-2, strlen("[ENTER TITLE]") + 1, title, 200);
+                                mvaddch(LINES-2, 0, ':');
+
+                                clrtoeol();
+
+                                mvprintw(LINES - 2, 0, "[ENTER CATEGORY]:");
+                                mvgetnstr(LINES-2, strlen("[ENTER CATEGORY]") + 1, ctg, 200);
+                                mvaddch(LINES-2, 0, ':');
+
+                                std::istringstream ss(ctg);
+                                std::istream_iterator<std::string> begin(ss), end;
+
+                                std::vector<std::string> arrayTokens(begin, end);
+
+                                noecho();
+                                clrtoeol();
+
+                                // Subscribing blocks, so show the status right away.
+                                update_statusline("[Adding subscription]", NULL, true);
+                                drawFrame();
+
+                                std::string errorMessage;
+                                if(strlen(feed) != 0){
+                                        try{
+                                                feedly.addSubscription(false, feed, arrayTokens, title);
+                                        }
+                                        catch(const std::exception& e){
+                                                errorMessage = e.what();
+                                        }
+                                }
+
+                                update_statusline(errorMessage.c_str(), NULL, errorMessage.empty());
+                        }
+
+                        break;
+                case 'A':
+                        if(auto currentCategoryItem = current_item(ctgMenu)){
+                                if(const auto view = mergedViews.find(categoryLabel(currentCategoryItem)); view != mergedViews.end()){
+                                        for(const auto& category : view->second){
+                                                if(const auto id = feedly.categoryId(category); !id.empty()){
+                                                        markCategoryRead(category, id);
+                                                }
+                                        }
+
+                                        if(view->first == currentCategory){
+                                                listPosts("");
+                                        }
+                                }
+                                else{
+                                        markCategoryRead(categoryLabel(currentCategoryItem), item_description(currentCategoryItem));
+                                }
+
+                                focusMenu(ctgMenu);
+                        }
+
+                        break;
+                case 'N':
+                        toggleStatsOverlay(false);
+                        break;
+                case 'F':
+                        toggleStatsOverlay(true);
+                        break;
+        }
+}
+void CursesProvider::focusMenu(MENU* menu){
+        curMenu = menu;
+
+        if(curMenu == postsMenu){
+                renderWindow(postsWin, "Posts", 1, true);
+                renderWindow(ctgWin, "Categories", 2, false);
+                update_infoline(POSTS_STATUSLINE);
+                top = panels[1];
         }
         else{
-                endwin();
-                feedly.curl_cleanup();
-                std::cerr << "ERROR: Couldn't not read config file" << std::endl;
-                exit(EXIT_FAILURE);
+                renderWindow(ctgWin, "Categories", 1, true);
+                renderWindow(postsWin, "Posts", 2, false);
+                update_infoline(CTG_STATUSLINE);
+                top = panels[0];
         }
 
-        if(textBrowser.empty()){
-                textBrowser = "w3m";
+        top_panel(top);
+}
+void CursesProvider::createCategoriesMenu(){
+        ctgMenu = new_menu(NULL);
+        set_menu_fore(ctgMenu, COLOR_PAIR(7) | A_REVERSE);
+        set_menu_back(ctgMenu, COLOR_PAIR(6));
+        set_menu_grey(ctgMenu, COLOR_PAIR(8));
+        set_menu_mark(ctgMenu, "  ");
+
+        menu_opts_off(ctgMenu, O_SHOWDESC);
+        menu_opts_on(ctgMenu, O_NONCYCLIC);
+}
+// (Re)create the category items, e.g. after the unread counts have changed.
+void CursesProvider::fillCategoryItems(){
+        const auto selectedItem = current_item(ctgMenu);
+        const auto selected = (selectedItem != NULL) ? item_index(selectedItem) : 0;
+
+        unpost_menu(ctgMenu);
+        set_menu_items(ctgMenu, NULL);
+        clearCategoryItems();
+
+        auto ordered = std::vector<const Categories::value_type*>{};
+        if(labels){
+                for(const auto& label : {"All", "Saved", "Uncategorized"}){
+                        if(const auto it = labels->find(label); it != labels->end()){
+                                ordered.push_back(&*it);
+                        }
+                }
+
+                for(const auto& entry : *labels){
+                        if((entry.first != "All") && (entry.first != "Saved") && (entry.first != "Uncategorized")){
+                                ordered.push_back(&entry);
+                        }
+                }
         }
 
-        if(textBrowser.at(0) == '~'){
-                textBrowser.replace(0, 1, getenv("HOME"));
+        // Below an expanded category come its feeds, labelled by their
+        // stream ids; merged views come last and have no stream id.
+        struct Row{
+                std::string name;
+                const std::string* label;
+                const std::string* id;
+        };
+
+        static const std::string noId;
+        auto rows = std::vector<Row>{};
+        for(const auto& entry : ordered){
+                rows.push_back({entry->first, &entry->first, &entry->second});
+                if(expandedCategories.count(entry->first) > 0){
+                        for(const auto feed : feedsOf(entry->first, entry->second)){
+                                rows.push_back({"  " + feed->title, &feed->id, &feed->id});
+                        }
+                }
         }
 
-        if (ctgWinWidth == 0)
-                ctgWinWidth = CTG_WIN_WIDTH;
-        if (viewWinHeight == 0 && viewWinHeightPer == 0)
-                viewWinHeightPer = VIEW_WIN_HEIGHT_PER;
-        if (viewWinHeight == 0)
-                viewWinHeight = (unsigned int)(((LINES - 2) * viewWinHeightPer) / 100);
+        for(const auto& [label, categories] : mergedViews){
+                rows.push_back({label, &label, &noId});
+        }
 
-        createCategoriesMenu();
-        createPostsMenu();
+        // Items keep pointers to their names, so build every name first.
+        ctgNames.clear();
+        for(const auto& row : rows){
+                ctgNames.push_back(categoryName(row.name, *row.id));
+        }
+
+        for(size_t i = 0; i < rows.size(); i++){
+                const auto item = new_item(ctgNames[i].c_str(), rows[i].id->c_str());
+                set_item_userptr(item, const_cast<std::string*>(rows[i].label));
+                ctgItems.push_back(item);
+        }
+
+        ctgItems.push_back(NULL);
+        set_menu_items(ctgMenu, ctgItems.data());
+        if(ctgItems.size() > 1){
+                set_current_item(ctgMenu, ctgItems.at(std::min<size_t>(selected, ctgItems.size() - 2)));
+        }
+
+        post_menu(ctgMenu);
+}
+// A category label followed by its unread count, aligned to the right edge.
+std::string CursesProvider::categoryName(const std::string& label, const std::string& id) const{
+        const auto count = unreadCounts.find(id);
+        if(count == unreadCounts.end()){
+                return label;
+        }
+
+        const auto countText = std::to_string(count->second);
+        const auto width = static_cast<size_t>(std::max(getmaxx(ctgMenuWin) - 2, 0));
+        if(width < countText.length() + 2){
+                return label;
+        }
+
+        auto name = label.substr(0, width - countText.length() - 1);
+        name.append(width - countText.length() - name.length(), ' ');
+        return name + countText;
+}
+const std::string& CursesProvider::categoryLabel(ITEM* item) const{
+        return *static_cast<const std::string*>(item_userptr(item));
+}
+// The feeds of a category by title; those of no category are under "Uncategorized".
+std::vector<const Subscription*> CursesProvider::feedsOf(const std::string& label, const std::string& id) const{
+        auto feeds = std::vector<const Subscription*>{};
+        if(!subscriptions){
+                return feeds;
+        }
+
+        for(const auto& feed : *subscriptions){
+                const auto inCategory = (label == "Uncategorized") ? feed.categoryIds.empty() :
+                        (std::find(feed.categoryIds.begin(), feed.categoryIds.end(), id) != feed.categoryIds.end());
+                if(inCategory){
+                        feeds.push_back(&feed);
+                }
+        }
+
+        std::sort(feeds.begin(), feeds.end(), [](const Subscription* a, const Subscription* b){
+                return std::tie(a->title, a->id) < std::tie(b->title, b->id);
+        });
+        return feeds;
+}
+// Show or hide the feeds of the category at item or, on a feed, of its category.
+void CursesProvider::expandCategory(ITEM* item, bool expand){
+        auto index = item_index(item);
+        while((index > 0) && isFeed(categoryLabel(ctgItems[index]))){
+                index--;
+        }
+
+        const auto label = categoryLabel(ctgItems[index]);
+        if(expand && feedsOf(label, item_description(ctgItems[index])).empty()){
+                update_statusline("[No feeds to show]", NULL, totalPosts > 0);
+                return;
+        }
+
+        if(expand){
+                expandedCategories.insert(label);
+        }
+        else{
+                expandedCategories.erase(label);
+        }
+
+        // The category keeps its place, as only the rows below it change.
+        fillCategoryItems();
+        set_current_item(ctgMenu, ctgItems[index]);
+}
+// Fetched once per session; the cached copy is shown until Feedly answers.
+void CursesProvider::fetchSubscriptions(){
+        subscriptionsRequest = feedly.requestSubscriptions([this](std::shared_ptr<const Subscriptions> newSubscriptions, const std::string& error){
+                subscriptionsRequest = 0;
+                // On error the feeds kept from the last session are still listed.
+                if(!error.empty()){
+                        update_statusline(error.c_str(), NULL, false);
+                }
+
+                if(newSubscriptions != subscriptions){
+                        subscriptions = std::move(newSubscriptions);
+                        fillCategoryItems();
+                }
+        }, Priority::BACKGROUND);
+}
+// The counts also tell the poller which categories got new entries; those
+// that are open or cached fetch just the new ones.
+void CursesProvider::refreshUnreadCounts(Priority priority){
+        if(countsRequest != 0){
+                return;
+        }
+
+        countsRequest = feedly.requestUnreadCounts([this](std::map<std::string, UnreadCount>&& counts, const std::string& error){
+                countsRequest = 0;
+                if(!error.empty()){
+                        return;
+                }
+
+                unreadCounts.clear();
+                auto categoryCounts = std::map<std::string, UnreadCount>{};
+                for(const auto& [id, count] : counts){
+                        unreadCounts[id] = count.count;
+                        if((id == currentCategory) || (labels && std::any_of(labels->begin(), labels->end(), [&id = id](const auto& label){ return label.second == id; }))){
+                                categoryCounts[id] = count;
+                        }
+                }
+
+                fillCategoryItems();
+
+                for(const auto& id : poller.update(categoryCounts, std::chrono::steady_clock::now())){
+                        // An open feed is labelled by its stream id.
+                        if(id == currentCategory){
+                                fetchNewPosts(id);
+                        }
+
+                        for(const auto& [label, labelId] : *labels){
+                                if((labelId == id) && ((label == currentCategory) || (streamCache.count(label) > 0))){
+                                        fetchNewPosts(label);
+                                }
+                        }
+                }
+        }, priority);
+}
+// The streams whose unread counts include a post: its categories and its feed.
+std::vector<std::string> CursesProvider::countedStreams(const PostData& post){
+        auto streams = post.categoryIds;
+        if(!post.feedId.empty()){
+                streams.push_back(post.feedId);
+        }
+
+        return streams;
+}
+// Apply a marker to the cached counts of the streams a post belongs to.
+// categoryIds may hold the categories of several posts; "All" changes once per post.
+void CursesProvider::adjustUnreadCounts(const std::vector<std::string>& categoryIds, int delta, int posts){
+        auto deltas = std::map<std::string, int>{};
+        for(const auto& id : categoryIds){
+                deltas[id] += delta;
+        }
+
+        if(labels){
+                if(const auto all = labels->find("All"); all != labels->end()){
+                        deltas[all->second] += delta * posts;
+                }
+        }
+
+        for(const auto& [id, change] : deltas){
+                if(const auto count = unreadCounts.find(id); count != unreadCounts.end()){
+                        count->second = std::max(count->second + change, 0);
+                }
+        }
+
+        fillCategoryItems();
+}
+void CursesProvider::runTimers(){
+        if(poller.due(std::chrono::steady_clock::now())){
+                refreshUnreadCounts(Priority::BACKGROUND);
+        }
+}
+void CursesProvider::createPostsMenu(){
+        postsMenu = new_menu(NULL);
+        set_menu_fore(postsMenu, COLOR_PAIR(7) | A_REVERSE);
+        set_menu_back(postsMenu, COLOR_PAIR(6));
+        set_menu_grey(postsMenu, COLOR_PAIR(8));
+        set_menu_mark(postsMenu, "*");
 
-        viewWin = newwin(viewWinHeight, COLS - 2, (LINES - 2 - viewWinHeight), 1);
+        menu_opts_off(postsMenu, O_SHOWDESC);
+}
+// (Re)create the windows for the terminal size and the configured layout.
+// The menus, their items and the selection are kept.
+void CursesProvider::layoutWindows(){
+        const auto viewHeightPer = (viewWinHeightPer != 0) ? viewWinHeightPer : VIEW_WIN_HEIGHT_PER;
+        const auto viewHeight = std::clamp((viewWinHeight != 0) ? viewWinHeight : ((LINES - 2) * viewHeightPer) / 100,
+                        1, std::max(LINES - 2 - MIN_LIST_HEIGHT, 1));
+        const auto listHeight = std::max(LINES - 2 - viewHeight, MIN_LIST_HEIGHT);
+        const auto ctgWidth = std::clamp(ctgWinWidth, MIN_LIST_WIDTH, std::max(COLS - MIN_LIST_WIDTH, MIN_LIST_WIDTH));
+
+        const auto selectedPost = current_item(postsMenu);
+        if(viewWin != NULL){
+                unpost_menu(ctgMenu);
+                unpost_menu(postsMenu);
+                for(const auto panel : panels){
+                        del_panel(panel);
+                }
+
+                delwin(ctgMenuWin);
+                delwin(ctgWin);
+                delwin(postsMenuWin);
+                delwin(postsWin);
+                delwin(viewWin);
+        }
+
+        ctgWin = newwin(listHeight, ctgWidth, 0, 0);
+        ctgMenuWin = derwin(ctgWin, listHeight - 4, ctgWidth - 2, 3, 1);
+        keypad(ctgWin, TRUE);
+
+        postsWin = newwin(listHeight, 0, 0, ctgWidth);
+        postsMenuWin = derwin(postsWin, listHeight - 4, getmaxx(postsWin) - 2, 3, 1);
+        keypad(postsWin, TRUE);
+
+        viewWin = newwin(viewHeight, COLS - 2, (LINES - 2 - viewHeight), 1);
+
+        set_menu_win(ctgMenu, ctgWin);
+        set_menu_sub(ctgMenu, ctgMenuWin);
+        set_menu_win(postsMenu, postsWin);
+        set_menu_sub(postsMenu, postsMenuWin);
+        set_menu_format(postsMenu, listHeight - 4, 0);
 
         panels[0] = new_panel(ctgWin);
         panels[1] = new_panel(postsWin);
@@ -119,391 +839,871 @@ void CursesProvider::init(){
         set_panel_userptr(panels[0], panels[1]);
         set_panel_userptr(panels[1], panels[0]);
 
-        printPostMenuMessage("Loading...");
-        update_infoline(POSTS_STATUSLINE);
+        if(statsPanel != NULL){
+                top_panel(statsPanel);
+        }
 
-        top = panels[1];
-        top_panel(top);
+        fillCategoryItems();
+        if(selectedPost != NULL){
+                set_current_item(postsMenu, selectedPost);
+        }
 
-        update_panels();
-        doupdate();
+        post_menu(postsMenu);
+        if(totalPosts == 0){
+                printPostMenuMessage(postsMessage);
+        }
 
-        ctgMenuCallback("All");
+        focusMenu((curMenu != NULL) ? curMenu : postsMenu);
+        frames.markDirty(FRAME_WINDOWS | FRAME_STATUS | FRAME_PREVIEW);
 }
-void CursesProvider::control(){
-        int ch;
-        MENU* curMenu;
-        if(totalPosts == 0){
-                curMenu = ctgMenu;
+// Curses has taken over the new terminal size by the time KEY_RESIZE is read.
+// Only the windows are rebuilt: the posts, the cursor and the streams stay,
+// and the preview is wrapped again to the new width.
+void CursesProvider::resizeWindows(){
+        werase(stdscr);
+        layoutWindows();
+        if(statsPanel != NULL){
+                placeStatsOverlay();
+        }
+
+        clearok(curscr, TRUE);
+        frames.markDirty(FRAME_OVERLAY);
+}
+void CursesProvider::ctgMenuCallback(const char* label, bool focusPosts){
+        markItemReadAutomatically(current_item(postsMenu));
+
+        // Only the latest category switch matters; drop a fetch still in flight.
+        feedly.cancelRequest(streamRequest);
+        cancelEntryRequests();
+        closeMergedView();
+
+        const auto category = std::string(label);
+        const auto refreshing = (category == currentCategory);
+        auto showingCache = false;
+        if(!refreshing){
+                clearSelection();
+                currentCategory = category;
+                if(const auto cached = streamCache.find(category); (cached != streamCache.end()) && (cached->second.rank == currentRank)){
+                        showPosts(std::vector<PostData>(cached->second.posts), "", focusPosts, false);
+                        showingCache = true;
+                }
+        }
+
+        update_statusline("[Updating stream]", "", false);
+
+        if(mergedViews.count(category) > 0){
+                openMergedView(category, focusPosts, refreshing);
+                return;
+        }
+
+        const auto rank = currentRank;
+        streamRequest = requestStream(category, rank,
+                        [this, category, rank, focusPosts, refreshing, showingCache](std::vector<PostData>&& newPosts, const std::string& error){
+                streamRequest = 0;
+                if(!error.empty() && showingCache){
+                        update_statusline(error.c_str(), NULL, false);
+                        return;
+                }
+
+                if(error.empty()){
+                        postStore.observe(newPosts);
+                        streamCache[category] = {newPosts, rank};
+                        if(category == "Saved"){
+                                prefetchArticles(newPosts);
+                        }
+                        else{
+                                analytics.recordIngested(newPosts);
+                        }
+                }
+
+                showPosts(std::move(newPosts), error, focusPosts && !showingCache, refreshing || showingCache);
+                reportInteractive();
+        });
+}
+// A merged view starts with the first page of each of its categories;
+// later pages are fetched as the cursor nears the end of the list.
+// The merge needs the posts' dates, so lazy_content doesn't apply.
+void CursesProvider::openMergedView(const std::string& label, bool focusPosts, bool keepSelection){
+        auto categories = std::vector<std::string>{};
+        for(const auto& category : mergedViews.at(label)){
+                if(!feedly.categoryId(category).empty()){
+                        categories.push_back(category);
+                }
+        }
+
+        if(categories.empty()){
+                showPosts({}, "None of the categories of " + label + " exists", focusPosts, false);
+                return;
+        }
+
+        merged = std::make_unique<MergedStream>(categories, currentRank);
+        mergedShown = false;
+        for(size_t source = 0; source < merged->size(); source++){
+                requestMergedPage(source, focusPosts, keepSelection);
+        }
+}
+void CursesProvider::requestMergedPage(size_t source, bool focusPosts, bool keepSelection){
+        pageRequests[source] = feedly.requestStreamPage(merged->category(source), currentRank, merged->continuation(source),
+                        [this, source, focusPosts, keepSelection](std::vector<PostData>&& page, const std::string& continuation, const std::string& error){
+                receiveMergedPage(source, std::move(page), continuation, error, focusPosts, keepSelection);
+        });
+}
+// A category whose page failed is left out of the rest of the merge.
+void CursesProvider::receiveMergedPage(size_t source, std::vector<PostData>&& page, const std::string& continuation,
+                const std::string& error, bool focusPosts, bool keepSelection){
+        pageRequests.erase(source);
+        if(error.empty()){
+                postStore.observe(page);
+                analytics.recordIngested(page);
         }
         else{
-                curMenu = postsMenu;
-                changeSelectedItem(curMenu, REQ_FIRST_ITEM);
+                update_statusline(error.c_str(), NULL, false);
         }
 
-        while((ch = getch()) != KEY_F(1) && ch != 'q'){
-                auto curItem = current_item(curMenu);
-                switch(ch){
-                        case 10:
-                                if((curMenu == ctgMenu) && (curItem != NULL)){
-                                        top = (PANEL *)panel_userptr(top);
+        merged->addPage(source, std::move(page), error.empty() ? continuation : "");
+        if(!merged->loaded()){
+                return;
+        }
 
-                                        update_statusline("[Updating stream]", "", false);
+        auto newPosts = std::vector<PostData>{};
+        merged->merge(newPosts);
+        if(!mergedShown){
+                mergedShown = true;
+                showPosts(std::move(newPosts), error, focusPosts, keepSelection);
+        }
+        else if(!newPosts.empty()){
+                const auto selectedItem = current_item(postsMenu);
+                const auto selectedId = (selectedItem != NULL) ? std::string(item_description(selectedItem)) : std::string{};
+                const auto row = (selectedItem != NULL) ? item_index(selectedItem) - top_row(postsMenu) : 0;
+                posts.insert(posts.end(), std::make_move_iterator(newPosts.begin()), std::make_move_iterator(newPosts.end()));
+                sortPosts();
+                relistPosts(selectedId, row);
+        }
 
-                                        refresh();
-                                        update_panels();
+        loadMergedPages();
+}
+// Once the cursor is within two screens of the end of the list, fetch the
+// next page of the categories holding up the merge, and only those.
+void CursesProvider::loadMergedPages(){
+        if(!merged || !mergedShown){
+                return;
+        }
 
-                                        ctgMenuCallback(item_name(curItem));
+        const auto rows = std::max(getmaxy(postsWin) - 4, 1);
+        const auto selected = current_item(postsMenu);
+        const auto index = (selected != NULL) ? item_index(selected) : 0;
+        if(index + 2 * rows < static_cast<int>(totalPosts)){
+                return;
+        }
 
-                                        top_panel(top);
+        for(const auto source : merged->starved()){
+                if(pageRequests.count(source) == 0){
+                        requestMergedPage(source, false, true);
+                }
+        }
+}
+void CursesProvider::closeMergedView(){
+        for(const auto& [source, request] : pageRequests){
+                feedly.cancelRequest(request);
+        }
 
-                                        if(numUnread == 0){
-                                                curMenu = ctgMenu;
-                                        }
-                                        else{
-                                                curMenu = postsMenu;
-                                                update_infoline(POSTS_STATUSLINE);
-                                        }
-                                }
-                                else if((panel_window(top) == postsWin) && (curItem != NULL)){
-                                        postsMenuCallback(curItem, true);
-                                }
+        pageRequests.clear();
+        merged.reset();
+        mergedShown = false;
+}
+void CursesProvider::prefetchCategories(){
+        if(!labels){
+                return;
+        }
 
-                                break;
-                        case 9:
-                                if(curMenu == ctgMenu){
-                                        curMenu = postsMenu;
+        prefetchQueue.clear();
+        for(const auto& [label, id] : *labels){
+                if(label != currentCategory){
+                        prefetchQueue.push_back(label);
+                }
+        }
 
-                                        renderWindow(postsWin, "Posts", 1, true);
-                                        renderWindow(ctgWin, "Categories", 2, false);
+        startPrefetches();
+}
+// Keep up to PREFETCH_CONCURRENCY category streams downloading in the background.
+void CursesProvider::startPrefetches(){
+        while(!prefetchQueue.empty() && (prefetchRequests.size() < PREFETCH_CONCURRENCY)){
+                const auto category = prefetchQueue.front();
+                prefetchQueue.pop_front();
+
+                if(prefetchRequests.count(category) > 0){
+                        continue;
+                }
 
-                                        update_infoline(POSTS_STATUSLINE);
-                                        refresh();
+                const auto rank = currentRank;
+                prefetchRequests[category] = requestStream(category, rank,
+                                [this, category, rank](std::vector<PostData>&& newPosts, const std::string& error){
+                        prefetchRequests.erase(category);
+                        if(error.empty()){
+                                postStore.observe(newPosts);
+                                if(category == "Saved"){
+                                        prefetchArticles(newPosts);
                                 }
                                 else{
-                                        curMenu = ctgMenu;
-                                        renderWindow(ctgWin, "Categories", 1, true);
-                                        renderWindow(postsWin, "Posts", 2, false);
+                                        analytics.recordIngested(newPosts);
+                                }
 
-                                        update_infoline(CTG_STATUSLINE);
+                                streamCache[category] = {std::move(newPosts), rank};
+                        }
 
-                                        refresh();
-                                }
+                        startPrefetches();
+                }, Priority::BACKGROUND);
+        }
+}
+void CursesProvider::cancelPrefetches(){
+        prefetchQueue.clear();
+        for(const auto& [category, id] : prefetchRequests){
+                feedly.cancelRequest(id);
+        }
 
-                                top = (PANEL *)panel_userptr(top);
-                                top_panel(top);
-                                break;
-                        case '=':
-                                if(auto currentCategoryItem = current_item(ctgMenu)){
-                                        wclear(viewWin);
-                                        update_statusline("[Updating stream]", "", false);
-                                        refresh();
+        prefetchRequests.clear();
+}
+// Keep the articles of saved posts on disk so they open without the network.
+// Entries only known by their id yet have no URL and wait for the next time.
+void CursesProvider::prefetchArticles(const std::vector<PostData>& saved){
+        for(const auto& post : saved){
+                if(post.complete && !post.originURL.empty() && (articleRequests.count(post.id) == 0) && !articles.contains(post.id) && !articles.evicted(post.id)){
+                        articleQueue.emplace_back(post.id, post.originURL);
+                }
+        }
 
-                                        currentRank = !currentRank;
+        startArticleDownloads();
+}
+// Up to ARTICLE_DOWNLOADS at a time; they share the connections of the API requests.
+void CursesProvider::startArticleDownloads(){
+        while(!articleQueue.empty() && (articleRequests.size() < ARTICLE_DOWNLOADS)){
+                const auto [id, url] = articleQueue.front();
+                articleQueue.pop_front();
+
+                if((articleRequests.count(id) > 0) || articles.contains(id)){
+                        continue;
+                }
 
-                                        ctgMenuCallback(item_name(currentCategoryItem));
+                articleRequests[id] = feedly.requestPage(url, [this, id = id](std::string&& html, const std::string& error){
+                        articleRequests.erase(id);
+                        try{
+                                if(!error.empty()){
+                                        throw std::runtime_error(error);
                                 }
 
-                                break;
-                        case KEY_DOWN:
-                                changeSelectedItem(curMenu, REQ_DOWN_ITEM);
-                                break;
-                        case KEY_UP:
-                                changeSelectedItem(curMenu, REQ_UP_ITEM);
-                                break;
-                        case 'j':
-                                changeSelectedItem(curMenu, REQ_DOWN_ITEM);
-                                break;
-                        case 'k':
-                                changeSelectedItem(curMenu, REQ_UP_ITEM);
-                                break;
-                        case 'u':
-                                if((curMenu == postsMenu) && (curItem != NULL) && !item_opts(curItem)){
-                                        update_statusline("[Marking post unread]", NULL, true);
-                                        refresh();
+                                articles.store(id, html);
+                        }
+                        catch(const std::exception& e){
+                                Logger::warning("Failed to keep the article of " + id + ": " + e.what());
+                        }
 
-                                        std::string errorMessage;
-                                        try{
-                                                feedly.markPostsUnread({item_description(curItem)});
+                        startArticleDownloads();
+                });
+        }
+}
+void CursesProvider::cancelArticleDownloads(){
+        articleQueue.clear();
+        for(const auto& [id, request] : articleRequests){
+                feedly.cancelRequest(request);
+        }
 
-                                                item_opts_on(curItem, O_SELECTABLE);
-                                                numUnread++;
-                                        }
-                                        catch(const std::exception& e){
-                                                errorMessage = e.what();
-                                        }
+        articleRequests.clear();
+}
+// The local copy of a saved post's article if there is one, else its URL.
+std::string CursesProvider::articleLocation(const PostData& post){
+        if(!articles.contains(post.id)){
+                return post.originURL;
+        }
 
-                                        update_statusline(errorMessage.c_str(), NULL, errorMessage.empty());
+        return articles.extract(post.id, post.originURL, previewPath.parent_path()).native();
+}
+// With lazy_content only the ids are fetched; loadVisibleEntries() fills
+// in the listed ones. Entries already loaded into the cache are reused.
+RequestId CursesProvider::requestStream(const std::string& category, bool rank, PostsCallback callback, Priority priority){
+        if(!feedly.getConfig()->lazyContent){
+                return feedly.requestStreamPosts(category, rank, std::move(callback), priority);
+        }
 
-                                        // Prevent an article marked as unread explicitly
-                                        // from being marked as read automatically.
-                                        lastPostSelectionTime = std::chrono::time_point<std::chrono::steady_clock>::max();
+        return feedly.requestStreamIds(category, rank,
+                        [this, category, callback](std::vector<std::string>&& ids, const std::string& error){
+                auto loaded = std::map<std::string, const PostData*>{};
+                if(const auto cached = streamCache.find(category); cached != streamCache.end()){
+                        for(const auto& post : cached->second.posts){
+                                if(post.complete){
+                                        loaded.emplace(post.id, &post);
                                 }
+                        }
+                }
 
-                                break;
-                        case 'r':
-                                if((curMenu == postsMenu) && (curItem != NULL)){
-                                        markItemRead(curItem);
-                                }
+                auto newPosts = std::vector<PostData>{};
+                newPosts.reserve(ids.size());
+                for(auto& id : ids){
+                        if(const auto post = loaded.find(id); post != loaded.end()){
+                                newPosts.push_back(*post->second);
+                        }
+                        else{
+                                auto placeholder = PostData{};
+                                placeholder.title = "...";
+                                placeholder.id = std::move(id);
+                                placeholder.complete = false;
+                                newPosts.push_back(std::move(placeholder));
+                        }
+                }
 
-                                break;
-                        case 's':
-                                if((curMenu == postsMenu) && (curItem != NULL)){
-                                        update_statusline("[Marking post saved]", NULL, true);
-                                        refresh();
+                callback(std::move(newPosts), error);
+        }, priority);
+}
+// Once an entry between a screen above the visible ones and a screen below
+// them lacks its content, fetch the content of everything up to three
+// screens below, MGET_BATCH_SIZE entries per request. Reading ahead that far
+// keeps scrolling from sending a request for every line.
+void CursesProvider::loadVisibleEntries(){
+        if(postsItems.size() <= 1){
+                return;
+        }
 
-                                        std::string errorMessage;
-                                        try{
-                                                feedly.markPostsSaved({item_description(curItem)});
-                                        }
-                                        catch(const std::exception& e){
-                                                errorMessage = e.what();
-                                        }
+        const auto rows = std::max(getmaxy(postsWin) - 4, 1);
+        const auto top = top_row(postsMenu);
+        const auto first = static_cast<size_t>(std::max(top - rows, 0));
+        const auto needed = std::min(static_cast<size_t>(top + 2 * rows), postsItems.size() - 1);
+        const auto last = std::min(static_cast<size_t>(top + 4 * rows), postsItems.size() - 1);
+        const auto missing = std::any_of(postsItems.begin() + first, postsItems.begin() + needed, [this](ITEM* item){
+                const auto& post = postAt(item);
+                return !post.complete && (entriesLoading.count(post.id) == 0);
+        });
+        if(!missing){
+                return;
+        }
 
-                                        update_statusline(errorMessage.c_str(), NULL, errorMessage.empty());
+        auto batch = std::vector<std::string>{};
+        for(auto i = first; i < last; i++){
+                const auto& post = postAt(postsItems[i]);
+                if(!post.complete && (entriesLoading.count(post.id) == 0)){
+                        batch.push_back(post.id);
+                }
+
+                if((batch.size() == MGET_BATCH_SIZE) || ((i + 1 == last) && !batch.empty())){
+                        entriesLoading.insert(batch.begin(), batch.end());
+                        entryRequests.push_back(feedly.requestEntries(batch,
+                                        [this, batch](std::vector<PostData>&& entries, const std::string& error){
+                                for(const auto& id : batch){
+                                        entriesLoading.erase(id);
                                 }
 
-                                break;
-                        case 'S':
-                                if((curMenu == postsMenu) && (curItem != NULL)){
-                                        update_statusline("[Marking post Unsaved]", NULL, true);
-                                        refresh();
+                                if(!error.empty()){
+                                        update_statusline(error.c_str(), NULL, false);
+                                        return;
+                                }
 
-                                        std::string errorMessage;
-                                        try{
-                                                feedly.markPostsUnsaved({item_description(curItem)});
-                                        }
-                                        catch(const std::exception& e){
-                                                errorMessage = e.what();
-                                        }
+                                fillEntries(std::move(entries));
+                        }));
+                        batch.clear();
+                }
+        }
+}
+// Put fetched content in place of the placeholders, in the list on screen
+// and in the cached streams, without reordering or moving the cursor.
+void CursesProvider::fillEntries(std::vector<PostData>&& entries){
+        postStore.observe(entries);
+        if(currentCategory != "Saved"){
+                analytics.recordIngested(entries);
+        }
+
+        auto byId = std::map<std::string, PostData>{};
+        for(auto& entry : entries){
+                auto id = entry.id;
+                byId.emplace(std::move(id), std::move(entry));
+        }
+
+        const auto fill = [&byId](std::vector<PostData>& list){
+                for(auto& post : list){
+                        if(const auto entry = byId.find(post.id); !post.complete && (entry != byId.end())){
+                                post = entry->second;
+                        }
+                }
+        };
 
-                                        update_statusline(errorMessage.c_str(), NULL, errorMessage.empty());
-                                }
+        for(auto& [category, cached] : streamCache){
+                fill(cached.posts);
+        }
 
-                                break;
-                        case 'R':
-                                if(auto currentCategoryItem = current_item(ctgMenu)){
-                                        wclear(viewWin);
-                                        update_statusline("[Updating stream]", "", false);
-                                        refresh();
+        const auto selectedItem = current_item(postsMenu);
+        const auto selectedId = (selectedItem != NULL) ? std::string(item_description(selectedItem)) : std::string{};
+        const auto row = (selectedItem != NULL) ? item_index(selectedItem) - top_row(postsMenu) : 0;
+        fill(posts);
+        sortPosts();
+        relistPosts(selectedId, row);
+}
+// Fetch the entries of a category crawled after the newest one loaded.
+void CursesProvider::fetchNewPosts(const std::string& label){
+        if(newPostsRequests.count(label) > 0){
+                return;
+        }
 
-                                        ctgMenuCallback(item_name(currentCategoryItem));
-                                }
+        const auto& known = (label == currentCategory) ? posts : streamCache[label].posts;
+        auto newest = 0LL;
+        for(const auto& post : known){
+                newest = std::max(newest, post.crawled);
+        }
 
-                                break;
-                        case 'o':
-                                if((curMenu == postsMenu) && (curItem != NULL)){
-                                        postsMenuCallback(curItem, false);
-                                }
+        newPostsRequests[label] = feedly.requestNewerPosts(label, newest,
+                        [this, label](std::vector<PostData>&& newPosts, const std::string& error){
+                newPostsRequests.erase(label);
+                if(error.empty()){
+                        mergeNewPosts(label, std::move(newPosts));
+                }
+        }, Priority::BACKGROUND);
+}
+// Add the entries that aren't loaded yet to the cached stream and, for the
+// open category, to the list, keeping the selected post where it is.
+void CursesProvider::mergeNewPosts(const std::string& label, std::vector<PostData>&& newPosts){
+        const auto unknown = [&newPosts](const std::vector<PostData>& list){
+                auto fresh = std::vector<PostData>{};
+                for(const auto& post : newPosts){
+                        if(std::none_of(list.begin(), list.end(), [&post](const PostData& known){ return known.id == post.id; })){
+                                fresh.push_back(post);
+                        }
+                }
 
-                                break;
-                        case 'O':
-                                if((curMenu == postsMenu) && (curItem != NULL)){
-                                        termios oldt;
-                                        tcgetattr(STDIN_FILENO, &oldt);
-                                        termios newt = oldt;
-                                        newt.c_lflag &= ~ECHO;
-                                        tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+                return fresh;
+        };
 
-                                        try{
-                                                PostData& data = feedly.getSinglePostData(item_index(curItem));
-#ifdef __APPLE__
-                                                execute("open", data.originURL);
-#else
-                                                execute("xdg-open", data.originURL);
-#endif
-                                                markItemRead(curItem);
-                                        }
-                                        catch(const std::exception& e){
-                                                update_statusline(e.what(), NULL /*post*/, false /*showCounter*/);
-                                        }
-                                }
+        if(const auto cached = streamCache.find(label); cached != streamCache.end()){
+                auto fresh = unknown(cached->second.posts);
+                cached->second.posts.insert(cached->second.posts.end(), fresh.begin(), fresh.end());
+        }
 
-                                break;
-                        case 'a':
-                                {
-                                        char feed[200];
-                                        char title[200];
-                                        char ctg[200];
-                                        echo();
+        if(label != currentCategory){
+                return;
+        }
 
-                                        clear_statusline();
-                                        attron(COLOR_PAIR(4));
-                                        mvprintw(LINES - 2, 0, "[ENTER FEED]:");
-                                        mvgetnstr(LINES-2, strlen("[ENTER FEED]") + 1, feed, 200);
-                                        mvaddch(LINES-2, 0, ':');
+        auto fresh = unknown(posts);
+        if(fresh.empty()){
+                return;
+        }
 
-                                        clrtoeol();
+        postStore.observe(fresh);
+        analytics.recordIngested(fresh);
 
-                                        mvprintw(LINES - 2, 0, "[ENTER TITLE]:");
-                                        mvgetnstr(LINES-2, strlen("[ENTER TITLE]") + 1, title, 200);
-                                        mvaddch(LINES-2, 0, ':');
+        const auto selectedItem = current_item(postsMenu);
+        const auto selectedId = (selectedItem != NULL) ? std::string(item_description(selectedItem)) : std::string{};
+        const auto row = (selectedItem != NULL) ? item_index(selectedItem) - top_row(postsMenu) : 0;
+        const auto count = fresh.size();
+        posts.insert(posts.end(), std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+        sortPosts();
+        relistPosts(selectedId, row);
 
-                                        clrtoeol();
+        const auto message = "[" + std::to_string(count) + " new post" + ((count == 1) ? "" : "s") + "]";
+        update_statusline(message.c_str(), NULL, true);
+}
+// Rebuild the list with selectedId shown on the given row of the menu,
+// if there is one, so a list changing in the background doesn't jump.
+void CursesProvider::relistPosts(const std::string& selectedId, int row){
+        listPosts(selectedId);
+
+        if(const auto selected = current_item(postsMenu); !selectedId.empty() && (selected != NULL) && (selectedId == item_description(selected))){
+                set_top_row(postsMenu, std::max(item_index(selected) - row, 0));
+                set_current_item(postsMenu, selected);
+                loadVisibleEntries();
+        }
 
-                                        mvprintw(LINES - 2, 0, "[ENTER CATEGORY]:");
-                                        mvgetnstr(LINES-2, strlen("[ENTER CATEGORY]") + 1, ctg, 200);
-                                        mvaddch(LINES-2, 0, ':');
+        frames.markDirty(FRAME_WINDOWS | FRAME_PREVIEW);
+}
+void CursesProvider::cancelEntryRequests(){
+        for(const auto id : entryRequests){
+                feedly.cancelRequest(id);
+        }
 
-                                        std::istringstream ss(ctg);
-                                        std::istream_iterator<std::string> begin(ss), end;
+        entryRequests.clear();
+        entriesLoading.clear();
+}
+void CursesProvider::showPosts(std::vector<PostData>&& newPosts, const std::string& errorMessage, bool focusPosts, bool keepSelection){
+        TraceSpan span{"ctgMenuCallback menu build"};
+
+        // Refreshing the list that is on screen shouldn't move the cursor.
+        auto selectedId = std::string{};
+        if(keepSelection){
+                if(const auto item = current_item(postsMenu)){
+                        selectedId = item_description(item);
+                }
+        }
 
-                                        std::vector<std::string> arrayTokens(begin, end);
+        posts = std::move(newPosts);
+        sortPosts();
+        listPosts(selectedId);
 
-                                        noecho();
-                                        clrtoeol();
+        update_statusline(errorMessage.c_str(), NULL, errorMessage.empty());
 
-                                        update_statusline("[Adding subscription]", NULL, true);
-                                        refresh();
+        if(focusPosts){
+                focusMenu((totalPosts > 0) ? postsMenu : ctgMenu);
+        }
+        else{
+                focusMenu(curMenu);
+        }
+}
+// Order the posts by the keys stored with them; ties keep the server's order.
+// A list already in order, like a merged view growing by a page, is kept as is.
+// Entries still waiting for their content have no keys yet: they keep their
+// place, and the loaded posts are ordered among the remaining places.
+void CursesProvider::sortPosts(){
+        TraceSpan span{"sort posts"};
+        const auto sortBy = [this](const auto& before){
+                if(std::all_of(posts.begin(), posts.end(), [](const PostData& post){ return post.complete; })){
+                        if(!std::is_sorted(posts.begin(), posts.end(), before)){
+                                std::stable_sort(posts.begin(), posts.end(), before);
+                        }
 
-                                        std::string errorMessage;
-                                        if(strlen(feed) != 0){
-                                                try{
-                                                        feedly.addSubscription(false, feed, arrayTokens, title);
-                                                }
-                                                catch(const std::exception& e){
-                                                        errorMessage = e.what();
-                                                }
-                                        }
+                        return;
+                }
 
-                                        update_statusline(errorMessage.c_str(), NULL, errorMessage.empty());
-                                }
+                auto places = std::vector<size_t>{};
+                auto loaded = std::vector<PostData>{};
+                for(size_t i = 0; i < posts.size(); i++){
+                        if(posts[i].complete){
+                                places.push_back(i);
+                                loaded.push_back(std::move(posts[i]));
+                        }
+                }
 
-                                break;
-                        case 'A':
-                                if(auto currentCategoryItem = current_item(ctgMenu)){
-                                        wclear(viewWin);
-                                        update_statusline("[Marking category read]", "", true);
-                                        refresh();
+                std::stable_sort(loaded.begin(), loaded.end(), before);
+                for(size_t i = 0; i < places.size(); i++){
+                        posts[places[i]] = std::move(loaded[i]);
+                }
+        };
+
+        switch(sortMode){
+                case SortMode::NEWEST:
+                        sortBy([](const PostData& a, const PostData& b){
+                                return a.published > b.published;
+                        });
+                        break;
+                case SortMode::OLDEST:
+                        sortBy([](const PostData& a, const PostData& b){
+                                return a.published < b.published;
+                        });
+                        break;
+                case SortMode::FEED:
+                        sortBy([](const PostData& a, const PostData& b){
+                                return std::tie(a.originTitle, a.feedId, b.published) < std::tie(b.originTitle, b.feedId, a.published);
+                        });
+                        break;
+                case SortMode::ENGAGEMENT:
+                        sortBy([](const PostData& a, const PostData& b){
+                                return std::tie(a.engagement, a.published) > std::tie(b.engagement, b.published);
+                        });
+                        break;
+                case SortMode::RANKED:
+                        // Scores from ingestion are stale once the model learned since.
+                        feedly.getRelevance().score(posts);
+                        sortBy([](const PostData& a, const PostData& b){
+                                return std::tie(a.score, a.published) > std::tie(b.score, b.published);
+                        });
+                        break;
+        }
+}
+// Build the menu items of the visible posts and select selectedId, or the first post.
+// Saved lists its posts whether they are read or not.
+void CursesProvider::listPosts(const std::string& selectedId){
+        unpost_menu(postsMenu);
+        set_menu_items(postsMenu, NULL);
+        clearPostItems();
+        for(size_t i = 0; i < posts.size(); i++){
+                const auto& state = postStore.state(posts[i].id);
+                if(state.visible || ((currentCategory == "Saved") && state.saved)){
+                        const auto item = new_item(posts[i].title.c_str(), posts[i].id.c_str());
+                        set_item_userptr(item, reinterpret_cast<void*>(i));
+                        postsItems.push_back(item);
+                }
+        }
 
-                                        std::string errorMessage;
-                                        try{
-                                                feedly.markCategoriesRead(item_description(currentCategoryItem), lastEntryRead);
-                                        }
-                                        catch(const std::exception& e){
-                                                update_statusline(errorMessage.c_str(), NULL, errorMessage.empty());
-                                        }
+        totalPosts = postsItems.size();
+        printPostMenuMessage("");
 
-                                        ctgMenuCallback(item_name(currentCategoryItem));
-                                        curMenu = ctgMenu;
-                                }
+        postsItems.push_back(NULL);
+        set_menu_items(postsMenu, postsItems.data());
+        set_menu_format(postsMenu, getmaxy(postsWin) - 4, 0);
+        post_menu(postsMenu);
+        syncPostItems();
 
-                                break;
+        if(totalPosts > 0){
+                const auto selected = std::find_if(postsItems.begin(), postsItems.end() - 1,
+                                [&selectedId](ITEM* item){ return selectedId == item_description(item); });
+                if(!selectedId.empty() && (selected != postsItems.end() - 1)){
+                        set_current_item(postsMenu, *selected);
+                        loadVisibleEntries();
+                        frames.markDirty(FRAME_PREVIEW);
+                }
+                else{
+                        // The new list hasn't been shown yet, so nothing in it has been read.
+                        lastPostSelectionTime = std::chrono::time_point<std::chrono::steady_clock>::max();
+                        changeSelectedItem(postsMenu, REQ_FIRST_ITEM);
+                }
+        }
+        else
+        {
+                printPostMenuMessage("All Posts Read");
+                werase(viewWin);
+        }
+}
+// Grey out the listed posts that are read and count the unread ones.
+void CursesProvider::syncPostItems(){
+        numUnread = 0;
+        for(const auto item : postsItems){
+                if(item == NULL){
+                        continue;
                 }
 
-                update_panels();
-                doupdate();
+                if(postStore.state(postAt(item).id).read){
+                        item_opts_off(item, O_SELECTABLE);
+                }
+                else{
+                        item_opts_on(item, O_SELECTABLE);
+                        numUnread++;
+                }
+        }
+}
+// Confirm a local change once the server accepted it, or undo it.
+void CursesProvider::settleChange(ChangeId change, const std::string& error, const std::function<void()>& undo){
+        if(error.empty()){
+                postStore.confirm(change);
+                update_statusline("", NULL, true);
+                return;
         }
 
-        markItemReadAutomatically(current_item(postsMenu));
+        postStore.rollback(change);
+        if(undo){
+                undo();
+        }
+
+        syncPostItems();
+        update_statusline(error.c_str(), NULL, false);
 }
-void CursesProvider::createCategoriesMenu(){
-        clearCategoryItems();
-        try{
-                const auto& labels = feedly.getLabels();
-                ctgItems.push_back(new_item("All", labels.at("All").c_str()));
-                ctgItems.push_back(new_item("Saved", labels.at("Saved").c_str()));
-                ctgItems.push_back(new_item("Uncategorized", labels.at("Uncategorized").c_str()));
-                for(const auto& [label, id] : labels){
-                        if((label != "All") && (label != "Saved") && (label != "Uncategorized")){
-                                ctgItems.push_back(new_item(label.c_str(), id.c_str()));
-                        }
+// The tagged posts and the range from the anchor to the cursor, or the
+// post under the cursor when nothing is selected. Copies, as the list may
+// be rebuilt before the server answers.
+std::vector<PostData> CursesProvider::selectedPosts() const{
+        auto selected = std::vector<PostData>{};
+        const auto current = current_item(postsMenu);
+        if(current == NULL){
+                return selected;
+        }
+
+        const auto [first, last] = visualRange();
+        for(auto i = 0U; i < totalPosts; i++){
+                const auto& post = postAt(postsItems[i]);
+                if((taggedPosts.count(post.id) > 0) || ((static_cast<int>(i) >= first) && (static_cast<int>(i) <= last))){
+                        selected.push_back(post);
                 }
         }
-        catch(const std::exception& e){
-                clearCategoryItems();
-                update_statusline(e.what(), NULL /*post*/, false /*showCounter*/);
+
+        if(selected.empty()){
+                selected.push_back(postAt(current));
         }
 
-        ctgItems.push_back(NULL);
-        ctgMenu = new_menu(ctgItems.data());
+        return selected;
+}
+// Indices of the first and last item of the range; an empty range without one.
+std::pair<int, int> CursesProvider::visualRange() const{
+        const auto current = current_item(postsMenu);
+        if(visualAnchor.empty() || (current == NULL)){
+                return {0, -1};
+        }
 
-        const auto ctgWinHeight = LINES - 2 - viewWinHeight;
-        ctgWin = newwin(ctgWinHeight, ctgWinWidth, 0, 0);
-        ctgMenuWin = derwin(ctgWin, (ctgWinHeight - 4), (ctgWinWidth - 2), 3, 1);
-        keypad(ctgWin, TRUE);
+        const auto anchor = std::find_if(postsItems.begin(), postsItems.end() - 1, [this](ITEM* item){
+                return postAt(item).id == visualAnchor;
+        });
+        const auto anchorIndex = (anchor != postsItems.end() - 1) ? item_index(*anchor) : item_index(current);
+        return std::minmax(anchorIndex, item_index(current));
+}
+void CursesProvider::clearSelection(){
+        taggedPosts.clear();
+        visualAnchor.clear();
+        frames.markDirty(FRAME_WINDOWS);
+}
+void CursesProvider::reportSelection(){
+        const auto count = (taggedPosts.empty() && visualAnchor.empty()) ? 0 : selectedPosts().size();
+        const auto message = "[" + std::to_string(count) + " selected" + (visualAnchor.empty() ? "" : ", v: end range") + "]";
+        update_statusline(message.c_str(), NULL, true);
+}
+// Tag the selected rows in the mark column; the menu redraws it with every move.
+void CursesProvider::drawSelectionMarks(){
+        if((postsMenuWin == NULL) || (taggedPosts.empty() && visualAnchor.empty())){
+                return;
+        }
 
-        set_menu_win(ctgMenu, ctgWin);
-        set_menu_sub(ctgMenu, ctgMenuWin);
-        set_menu_fore(ctgMenu, COLOR_PAIR(7) | A_REVERSE);
-        set_menu_back(ctgMenu, COLOR_PAIR(6));
-        set_menu_grey(ctgMenu, COLOR_PAIR(8));
-        set_menu_mark(ctgMenu, "  ");
+        int rows, columns;
+        menu_format(postsMenu, &rows, &columns);
 
-        renderWindow(ctgWin, "Categories", 2, false);
+        const auto [first, last] = visualRange();
+        const auto top = top_row(postsMenu);
+        for(auto row = 0; (row < rows) && (top + row < static_cast<int>(totalPosts)); row++){
+                const auto index = top + row;
+                if((taggedPosts.count(postAt(postsItems[index]).id) > 0) || ((index >= first) && (index <= last))){
+                        mvwaddch(postsMenuWin, row, 0, '+');
+                }
+        }
+}
+// Each action goes out as one markers request for the whole selection.
+void CursesProvider::markSelectionRead(bool read){
+        auto ids = std::vector<std::string>{};
+        auto categoryIds = std::vector<std::string>{};
+        for(const auto& post : selectedPosts()){
+                if(postStore.state(post.id).read == read){
+                        continue;
+                }
 
-        menu_opts_off(ctgMenu, O_SHOWDESC);
-        menu_opts_on(ctgMenu, O_NONCYCLIC);
+                ids.push_back(post.id);
+                const auto streams = countedStreams(post);
+                categoryIds.insert(categoryIds.end(), streams.begin(), streams.end());
+                if(read){
+                        analytics.recordUnopened(post);
+                        feedly.getRelevance().learn(post, Reaction::READ);
+                }
+        }
 
-        post_menu(ctgMenu);
-}
-void CursesProvider::createPostsMenu(){
-        const auto height = LINES - 2 - viewWinHeight;
-        postsWin = newwin(height, 0, 0, ctgWinWidth);
-        keypad(postsWin, TRUE);
+        clearSelection();
+        if(ids.empty()){
+                return;
+        }
 
-        const auto width = getmaxx(postsWin);
-        postsMenuWin = derwin(postsWin, height - 4, width - 2, 3, 1);
+        const auto count = static_cast<int>(ids.size());
+        const auto delta = read ? -1 : 1;
+        const auto change = postStore.markRead(ids, read);
+        adjustUnreadCounts(categoryIds, delta, count);
+        syncPostItems();
 
-        postsMenu = new_menu(NULL);
-        set_menu_win(postsMenu, postsWin);
-        set_menu_sub(postsMenu, postsMenuWin);
-        set_menu_fore(postsMenu, COLOR_PAIR(7) | A_REVERSE);
-        set_menu_back(postsMenu, COLOR_PAIR(6));
-        set_menu_grey(postsMenu, COLOR_PAIR(8));
-        set_menu_mark(postsMenu, "*");
+        const auto message = "[Marking " + ((count == 1) ? "post"s : std::to_string(count) + " posts") + (read ? " read]" : " unread]");
+        update_statusline(message.c_str(), NULL, true);
 
-        renderWindow(postsWin, "Posts", 1, true);
+        const auto onDone = [this, change, categoryIds, delta, count](const std::string& error){
+                settleChange(change, error, [this, categoryIds, delta, count]{ adjustUnreadCounts(categoryIds, -delta, count); });
+        };
 
-        menu_opts_off(postsMenu, O_SHOWDESC);
+        if(read){
+                feedly.markPostsRead(ids, onDone);
+        }
+        else{
+                feedly.markPostsUnread(ids, onDone);
 
-        post_menu(postsMenu);
+                // Prevent an article marked as unread explicitly
+                // from being marked as read automatically.
+                lastPostSelectionTime = std::chrono::time_point<std::chrono::steady_clock>::max();
+        }
 }
-void CursesProvider::ctgMenuCallback(const char* label){
-        markItemReadAutomatically(current_item(postsMenu));
+void CursesProvider::markSelectionSaved(bool saved){
+        auto changed = std::vector<PostData>{};
+        auto ids = std::vector<std::string>{};
+        for(auto& post : selectedPosts()){
+                if(postStore.state(post.id).saved != saved){
+                        ids.push_back(post.id);
+                        changed.push_back(std::move(post));
+                }
+        }
 
-        int startx, height, width;
-        [[maybe_unused]] int starty;
+        clearSelection();
+        if(ids.empty()){
+                return;
+        }
 
-        getmaxyx(postsWin, height, width);
-        getbegyx(postsWin, starty, startx);
+        const auto change = postStore.markSaved(ids, saved);
+        const auto message = "[Marking " + ((ids.size() == 1) ? "post"s : std::to_string(ids.size()) + " posts") + (saved ? " saved]" : " unsaved]");
+        update_statusline(message.c_str(), NULL, true);
 
-        std::string errorMessage;
-        clearPostItems();
-        try{
-                const auto& posts = feedly.giveStreamPosts(label, currentRank);
-                for(const auto& post : posts){
-                        postsItems.push_back(new_item(post.title.c_str(), post.id.c_str()));
+        if(saved){
+                for(const auto& post : changed){
+                        feedly.getRelevance().learn(post, Reaction::SAVED);
+                        analytics.recordSaved(post);
                 }
+
+                feedly.markPostsSaved(ids, [this, change, changed](const std::string& error){
+                        settleChange(change, error);
+                        if(error.empty()){
+                                prefetchArticles(changed);
+                        }
+                });
         }
-        catch(const std::exception& e){
-                clearPostItems();
-                errorMessage = e.what();
+        else{
+                feedly.markPostsUnsaved(ids, [this, change, ids](const std::string& error){
+                        settleChange(change, error);
+                        if(error.empty()){
+                                for(const auto& id : ids){
+                                        articles.remove(id);
+                                }
+                        }
+                });
         }
+}
+// Everything loaded from the category becomes read locally, so the list
+// is emptied without fetching it again. Only the marker goes to the server.
+void CursesProvider::markCategoryRead(const std::string& label, const std::string& id){
+        const auto inCategory = [&label, &id](const PostData& post){
+                return (label == "All") || (post.feedId == id) || (std::find(post.categoryIds.begin(), post.categoryIds.end(), id) != post.categoryIds.end());
+        };
+
+        // Posts marked read this way were passed over without being opened.
+        auto ids = std::vector<std::string>{};
+        auto seen = std::set<std::string>{};
+        auto categoryIds = std::vector<std::string>{};
+        // The marker covers the category up to its newest loaded entry, read or not.
+        auto newestId = std::string{};
+        auto newestCrawled = 0LL;
+        auto collect = [this, &ids, &seen, &categoryIds, &newestId, &newestCrawled](const PostData& post){
+                if(post.crawled > newestCrawled){
+                        newestId = post.id;
+                        newestCrawled = post.crawled;
+                }
 
-        totalPosts = postsItems.size();
-        numUnread = totalPosts;
-        printPostMenuMessage("");
+                if(!postStore.state(post.id).read && seen.insert(post.id).second){
+                        ids.push_back(post.id);
+                        feedly.getRelevance().learn(post, Reaction::SKIPPED);
+                        analytics.recordUnopened(post);
+                        const auto streams = countedStreams(post);
+                        categoryIds.insert(categoryIds.end(), streams.begin(), streams.end());
+                }
+        };
 
-        postsItems.push_back(NULL);
-        unpost_menu(postsMenu);
-        set_menu_items(postsMenu, postsItems.data());
-        set_menu_format(postsMenu, height - 4, 0);
-        post_menu(postsMenu);
+        for(const auto& post : posts){
+                if((label == currentCategory) || inCategory(post)){
+                        collect(post);
+                }
+        }
 
-        update_statusline(errorMessage.c_str(), NULL, errorMessage.empty());
-        renderWindow(postsWin, "Posts", 1, true);
-        renderWindow(ctgWin, "Categories", 2, false);
+        for(const auto& [category, cached] : streamCache){
+                for(const auto& post : cached.posts){
+                        if((category == label) || inCategory(post)){
+                                collect(post);
+                        }
+                }
+        }
 
-        if(totalPosts > 0){
-                lastEntryRead = item_description(postsItems.at(0));
-                changeSelectedItem(postsMenu, REQ_FIRST_ITEM);
+        if(!ids.empty()){
+                adjustUnreadCounts(categoryIds, -1, static_cast<int>(ids.size()));
         }
-        else
-        {
-                printPostMenuMessage("All Posts Read");
-                wclear(viewWin);
+
+        if(const auto count = unreadCounts.find(id); count != unreadCounts.end()){
+                count->second = 0;
+                fillCategoryItems();
+        }
+
+        const auto change = postStore.markRead(ids, true);
+        if(label == currentCategory){
+                listPosts("");
+        }
+        else{
+                syncPostItems();
         }
+
+        update_statusline("[Marking category read]", "", true);
+
+        feedly.markCategoriesRead(id, newestId, [this, change, label](const std::string& error){
+                settleChange(change, error, [this, label]{
+                        // The exact counts before the change are unknown; ask the server.
+                        refreshUnreadCounts();
+                        if(label == currentCategory){
+                                listPosts("");
+                        }
+                });
+        });
 }
 void CursesProvider::changeSelectedItem(MENU* curMenu, int req){
         ITEM* previousItem = current_item(curMenu);
@@ -517,30 +1717,47 @@ void CursesProvider::changeSelectedItem(MENU* curMenu, int req){
         }
 
         markItemReadAutomatically(previousItem);
-
+        loadVisibleEntries();
+        loadMergedPages();
+        frames.markDirty(FRAME_PREVIEW);
+}
+void CursesProvider::renderPreview(ITEM* curItem){
+        TraceSpan span{"preview render"};
         try{
-                const auto& postData = feedly.getSinglePostData(item_index(curItem));
-                if(auto myfile = std::ofstream(previewPath.c_str())){
-                        myfile << postData.content;
-                }
-
-                std::string content;
-                char buffer[256];
-                const auto command = "w3m -dump -cols " + std::to_string(COLS - 2) + " " + previewPath.native();
-                if(const auto stream = PipeStream(popen(command.c_str(), "r"), &pclose)){
-                        while(!feof(stream.get())){
-                                if(fgets(buffer, 256, stream.get()) != NULL){
-                                        content.append(buffer);
+                const auto& postData = postAt(curItem);
+                if(!postData.complete){
+                        werase(viewWin);
+                        mvwprintw(viewWin, 1, 1, "Loading...");
+                        return;
+                }
+
+                // The list changing in the background redraws the preview too;
+                // w3m only runs again for another post or another width.
+                const auto width = getmaxx(viewWin);
+                if((postData.id != previewId) || (width != previewWidth)){
+                        if(auto myfile = std::ofstream(previewPath.c_str())){
+                                myfile << postData.content;
+                        }
+
+                        std::string content;
+                        char buffer[256];
+                        const auto command = "w3m -dump -cols " + std::to_string(width) + " " + previewPath.native();
+                        if(const auto stream = PipeStream(popen(command.c_str(), "r"), &pclose)){
+                                while(!feof(stream.get())){
+                                        if(fgets(buffer, 256, stream.get()) != NULL){
+                                                content.append(buffer);
+                                        }
                                 }
                         }
+
+                        previewId = postData.id;
+                        previewWidth = width;
+                        previewText = std::move(content);
                 }
 
-                wclear(viewWin);
-                mvwprintw(viewWin, 1, 1, content.c_str());
-                wrefresh(viewWin);
+                werase(viewWin);
+                mvwaddstr(viewWin, 1, 1, previewText.c_str());
                 update_statusline(NULL, (postData.originTitle + " - " + postData.title).c_str(), true);
-
-                update_panels();
         }
         catch (const std::exception& e){
                 update_statusline(e.what(), NULL /*post*/, false /*showCounter*/);
@@ -550,7 +1767,11 @@ void CursesProvider::postsMenuCallback(ITEM* item, bool preview){
         auto command = std::string{};
         auto arg = std::string{};
         try{
-                const auto& postData = feedly.getSinglePostData(item_index(item));
+                const auto& postData = postAt(item);
+                if(!postData.complete){
+                        throw std::runtime_error("The post is still loading");
+                }
+
                 if(preview){
                         if(auto myfile = std::ofstream(previewPath.c_str())){
                                 myfile << postData.content;
@@ -561,7 +1782,7 @@ void CursesProvider::postsMenuCallback(ITEM* item, bool preview){
                 }
                 else{
                         command = textBrowser;
-                        arg = postData.originURL;
+                        arg = articleLocation(postData);
                 }
 
         }
@@ -572,8 +1793,9 @@ void CursesProvider::postsMenuCallback(ITEM* item, bool preview){
 
         const auto exitCode = execute(command, arg);
         if(exitCode == 0){
-                markItemRead(item);
-                lastEntryRead = item_description(item);
+                feedly.getRelevance().learn(postAt(item), Reaction::OPENED);
+                analytics.recordOpened(postAt(item));
+                markItemRead(item, true);
         }
         else{
                 const auto updateStatus = preview ? "Failed to preview the post" : "Failed to open the post";
@@ -585,29 +1807,41 @@ void CursesProvider::postsMenuCallback(ITEM* item, bool preview){
                 fs::remove(previewPath, errorCode);
         }
 }
-void CursesProvider::markItemRead(ITEM* item){
-        if(item_opts(item)){
-                item_opts_off(item, O_SELECTABLE);
-                update_statusline("[Marking post read]", NULL, true);
-                refresh();
-
-                std::string errorMessage;
-                try{
-                        const auto& postData = feedly.getSinglePostData(item_index(item));
-                        feedly.markPostsRead({postData.id});
-                        numUnread--;
+const PostData& CursesProvider::postAt(ITEM* item) const{
+        return posts.at(reinterpret_cast<size_t>(item_userptr(item)));
+}
+// An opened post has been learned from already, as opened.
+void CursesProvider::markItemRead(ITEM* item, bool opened){
+        try{
+                const auto& postData = postAt(item);
+                if(postStore.state(postData.id).read){
+                        return;
                 }
-                catch (const std::exception& e){
-                        errorMessage = e.what();
+
+                const auto change = postStore.markRead({postData.id}, true);
+                if(!opened){
+                        feedly.getRelevance().learn(postData, Reaction::READ);
                 }
 
-                update_statusline(errorMessage.c_str(), NULL, errorMessage.empty());
-                update_panels();
+                adjustUnreadCounts(countedStreams(postData), -1);
+                syncPostItems();
+                update_statusline("[Marking post read]", NULL, true);
+
+                feedly.markPostsRead({postData.id}, [this, change, categoryIds = countedStreams(postData)](const std::string& error){
+                        settleChange(change, error, [this, categoryIds]{ adjustUnreadCounts(categoryIds, 1); });
+                });
+        }
+        catch (const std::exception& e){
+                update_statusline(e.what(), NULL, false);
         }
 }
 // Mark an article as read if it has been shown for more than a certain period of time.
 void CursesProvider::markItemReadAutomatically(ITEM* item){
         const auto now = std::chrono::steady_clock::now();
+        if((item != NULL) && (now > lastPostSelectionTime)){
+                analytics.recordPreview(postAt(item), std::chrono::duration_cast<std::chrono::milliseconds>(now - lastPostSelectionTime));
+        }
+
         if ((item != NULL) &&
             (now > lastPostSelectionTime) &&
             (secondsToMarkAsRead >= std::chrono::seconds::zero()) &&
@@ -673,6 +1907,7 @@ void CursesProvider::printPostMenuMessage(const std::string& message){
         const auto y = height / 2;
         const auto x = (width - message.length()) / 2;
 
+        postsMessage = message;
         werase(postsMenuWin);
         wattron(postsMenuWin, 1);
         mvwprintw(postsMenuWin, y, x, message.c_str());
@@ -696,9 +1931,14 @@ void CursesProvider::update_statusline(const char* update, const char* post, boo
                 statusLine[2] = std::string();
         }
 
+        frames.markDirty(FRAME_STATUS);
+}
+void CursesProvider::update_infoline(const char* info){
+        infoLine = info;
+        frames.markDirty(FRAME_STATUS);
+}
+void CursesProvider::drawStatusline(){
         clear_statusline();
-        move(LINES - 2, 0);
-        clrtoeol();
         attron(COLOR_PAIR(1));
         mvprintw(LINES - 2, 0, statusLine[0].c_str());
         attroff(COLOR_PAIR(1));
@@ -707,25 +1947,162 @@ void CursesProvider::update_statusline(const char* update, const char* post, boo
         attron(COLOR_PAIR(3));
         mvprintw(LINES - 2, COLS - statusLine[2].length(), statusLine[2].c_str());
         attroff(COLOR_PAIR(3));
-        refresh();
-        update_panels();
-}
-void CursesProvider::update_infoline(const char* info){
-        move(LINES-1, 0);
+
+        move(LINES - 1, 0);
         clrtoeol();
         attron(COLOR_PAIR(5));
-        mvprintw(LINES - 1, 0, info);
+        mvprintw(LINES - 1, 0, infoLine.c_str());
         attroff(COLOR_PAIR(5));
 }
+// Draw the regions marked dirty since the last frame and write them to the terminal at once.
+void CursesProvider::drawFrame(){
+        if(frames.isDirty(FRAME_PREVIEW) && (totalPosts > 0)){
+                if(const auto item = current_item(postsMenu)){
+                        renderPreview(item);
+                }
+        }
+
+        const auto regions = frames.beginFrame();
+        if(regions & FRAME_STATUS){
+                drawStatusline();
+        }
+
+        if(statsPanel != NULL){
+                if(showFeedStats){
+                        renderFeedStats();
+                }
+                else{
+                        renderStatsOverlay();
+                }
+
+                top_panel(statsPanel);
+        }
+
+        drawSelectionMarks();
+        update_panels();
+        {
+                TraceSpan span{"doupdate"};
+                doupdate();
+        }
+}
+// The network stats and the feed counters share the overlay; the key of
+// the one not shown switches to it.
+void CursesProvider::toggleStatsOverlay(bool feeds){
+        if((statsPanel != NULL) && (feeds != showFeedStats)){
+                showFeedStats = feeds;
+                frames.markDirty(FRAME_OVERLAY);
+                return;
+        }
+
+        showFeedStats = feeds;
+        if(statsPanel != NULL){
+                del_panel(statsPanel);
+                delwin(statsWin);
+                statsPanel = NULL;
+                statsWin = NULL;
+                frames.markDirty(FRAME_WINDOWS);
+                return;
+        }
+
+        placeStatsOverlay();
+        frames.markDirty(FRAME_OVERLAY);
+}
+// (Re)create the overlay in the middle of the terminal.
+void CursesProvider::placeStatsOverlay(){
+        if(statsPanel != NULL){
+                del_panel(statsPanel);
+                delwin(statsWin);
+        }
+
+        const auto height = std::max(LINES - 6, 6);
+        const auto width = std::max(COLS - 8, 20);
+        statsWin = newwin(height, width, (LINES - height) / 2, (COLS - width) / 2);
+        statsPanel = new_panel(statsWin);
+}
+void CursesProvider::renderStatsOverlay(){
+        werase(statsWin);
+        renderWindow(statsWin, "Network Stats (ms)", 1, true);
+
+        const auto width = getmaxx(statsWin);
+        const auto height = getmaxy(statsWin);
+        const auto ms = [](curl_off_t us){ return us / 1000.0; };
+
+        auto line = std::array<char, 256>{};
+        snprintf(line.data(), line.size(), "%-24.24s %6s %7s %7s %7s %7s %8s %8s %8s %7s %9s %8s %9s",
+                        "Endpoint", "Count", "DNS", "TCP", "TLS", "TTFB", "p50", "p90", "p99", "Parse", "KiB", "Resp p99", "Hedge won");
+        wattron(statsWin, COLOR_PAIR(5));
+        mvwaddnstr(statsWin, 3, 1, line.data(), width - 2);
+        wattroff(statsWin, COLOR_PAIR(5));
+
+        auto y = 4;
+        for(const auto& summary : feedly.getNetworkStats().summarize()){
+                if(y >= height - 1){
+                        break;
+                }
+
+                const auto hedges = std::to_string(summary.hedgesWon) + "/" + std::to_string(summary.hedged);
+                snprintf(line.data(), line.size(), "%-24.24s %6lu %7.1f %7.1f %7.1f %7.1f %8.1f %8.1f %8.1f %7.1f %9.1f %8.1f %9s",
+                                summary.endpoint.c_str(),
+                                summary.requests,
+                                ms(summary.dnsMedian),
+                                ms(summary.tcpMedian),
+                                ms(summary.tlsMedian),
+                                ms(summary.ttfbMedian),
+                                ms(summary.totalP50),
+                                ms(summary.totalP90),
+                                ms(summary.totalP99),
+                                ms(summary.parseMedian),
+                                summary.bytesDown / 1024.0,
+                                ms(summary.responseP99),
+                                hedges.c_str());
+                mvwaddnstr(statsWin, y++, 1, line.data(), width - 2);
+        }
+}
+void CursesProvider::renderFeedStats(){
+        werase(statsWin);
+        renderWindow(statsWin, "Feed Stats (= : change sort)", 1, true);
+
+        const auto width = getmaxx(statsWin);
+        const auto height = getmaxy(statsWin);
+
+        auto line = std::array<char, 256>{};
+        snprintf(line.data(), line.size(), "%-32.32s %8s %8s %7s %9s %6s %12s",
+                        "Feed", "Posts", "Opened", "Read %", "Unopened", "Saved", "Preview min");
+        wattron(statsWin, COLOR_PAIR(5));
+        mvwaddnstr(statsWin, 3, 1, line.data(), width - 2);
+        wattroff(statsWin, COLOR_PAIR(5));
+
+        auto y = 4;
+        for(const auto& [id, counters] : analytics.sorted(feedColumn)){
+                if(y >= height - 1){
+                        break;
+                }
+
+                snprintf(line.data(), line.size(), "%-32.32s %8lu %8lu %7.1f %9lu %6lu %12.1f",
+                                (counters.title.empty() ? id : counters.title).c_str(),
+                                counters.ingested,
+                                counters.opened,
+                                counters.readRate() * 100,
+                                counters.unopened,
+                                counters.saved,
+                                counters.previewMs / 60000.0);
+                mvwaddnstr(statsWin, y++, 1, line.data(), width - 2);
+        }
+}
 int CursesProvider::execute(const std::string& command, const std::string& arg){
+        TraceSpan span{"execute", command};
+
         throwIfError(def_prog_mode(), "make the program mode default");
         throwIfError(endwin(), "end the curses window");
 
-        switch(fork()){
+        const auto pid = fork();
+        switch(pid){
         case -1:{
                 throw std::runtime_error("Failed to fork");
         }
         case 0:{
+                ChildReaper::resetSignalMask();
+
                 // Suppress the standard output from a web browser in a GUI session
                 // (detected based on DISPLAY and WAYLAND_DISPLAY environment variables)
                 // because such a browser may output error messages to the standard output.
@@ -745,13 +2122,24 @@ int CursesProvider::execute(const std::string& command, const std::string& arg){
                 exit(errno);
         }
         default:{
+                // Wait for this child only; background browsers are reaped by reapChildren().
                 int wstatus;
-                wait(&wstatus);
+                while((waitpid(pid, &wstatus, 0) == -1) && (errno == EINTR)){
+                }
+
                 throwIfError(reset_prog_mode(), "update the screen");
                 return WEXITSTATUS(wstatus);
         }
         }
 }
+void CursesProvider::reapChildren(){
+        for(const auto& child : children.reap()){
+                if(!WIFEXITED(child.status) || (WEXITSTATUS(child.status) != 0)){
+                        const auto status = WIFEXITED(child.status) ? WEXITSTATUS(child.status) : 128 + WTERMSIG(child.status);
+                        update_statusline(("'" + child.command + "' exited with status " + std::to_string(status)).c_str(), NULL, false);
+                }
+        }
+}
 void CursesProvider::clearCategoryItems(){
         for(const auto& ctgItem : ctgItems){
                 if(ctgItem != NULL){
@@ -781,6 +2169,15 @@ CursesProvider::~CursesProvider(){
                 free_menu(postsMenu);
         }
 
+        if(statsPanel != NULL){
+                del_panel(statsPanel);
+                delwin(statsWin);
+        }
+
+        if(inputPad != NULL){
+                delwin(inputPad);
+        }
+
         clearCategoryItems();
         clearPostItems();
         endwin();
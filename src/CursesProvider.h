@@ -1,5 +1,9 @@
 #include <chrono>
+#include <deque>
 #include <iostream>
+#include <set>
+
+#include <signal.h>
 
 #include <curses.h>
 #include <menu.h>
@@ -8,10 +12,28 @@
 #ifndef _CURSES_H
 #define _CURSES_H
 
+#include "ArticleCache.h"
+#include "ChildReaper.h"
+#include "FeedAnalytics.h"
 #include "FeedlyProvider.h"
+#include "FrameScheduler.h"
+#include "MergedStream.h"
+#include "PostStore.h"
+#include "StreamPoller.h"
 
 #define CTG_WIN_WIDTH 40
 #define VIEW_WIN_HEIGHT_PER 50
+#define PREFETCH_CONCURRENCY 4
+#define ESC_DELAY_MS 25
+#define EVENT_LOOP_TIMEOUT_MS 1000
+#define EXIT_FLUSH_SECONDS 5
+#define MAX_FRAME_RATE 30
+#define MIN_LIST_HEIGHT 6
+#define MIN_LIST_WIDTH 10
+#define MGET_BATCH_SIZE 50
+#define ARTICLE_DOWNLOADS 4
+
+enum class SortMode{NEWEST, OLDEST, FEED, ENGAGEMENT, RANKED};
 
 class CursesProvider{
         public:
@@ -19,30 +41,150 @@ class CursesProvider{
                 void init();
                 void control();
                 ~CursesProvider();
+                // For SIGINT and SIGTERM handlers: ask control() to return, if it is running,
+                // or to stop waiting for the last requests once it is returning.
+                static bool requestStop(){
+                        stopRequested = 1;
+                        return looping;
+                }
         private:
+                static inline volatile sig_atomic_t looping{}, stopRequested{};
+                const std::chrono::steady_clock::time_point startTime{std::chrono::steady_clock::now()};
+                // main() has blocked SIGCHLD before starting any thread; this reads it.
+                ChildReaper children;
                 FeedlyProvider feedly;
-                WINDOW *ctgWin, *postsWin, *viewWin, *ctgMenuWin, *postsMenuWin;
+                ConfigWatcher configWatcher{feedly.getConfigPath()};
+                WINDOW *ctgWin{}, *postsWin{}, *viewWin{}, *ctgMenuWin{}, *postsMenuWin{};
                 PANEL  *panels[3], *top;
+                WINDOW *statsWin{};
+                PANEL  *statsPanel{};
+                // Whether the overlay shows the feed counters instead of the network stats.
+                bool showFeedStats{};
+                FeedColumn feedColumn{FeedColumn::INGESTED};
+                WINDOW *inputPad{};
+                FrameScheduler frames{std::chrono::milliseconds(1000 / MAX_FRAME_RATE)};
                 std::vector<ITEM*> ctgItems{};
+                std::vector<std::string> ctgNames{};
                 std::vector<ITEM*> postsItems{};
-                MENU *ctgMenu, *postsMenu;
-                std::string lastEntryRead, statusLine[3];
+                // Posts selected for the bulk actions: tagged one by one, or in the range
+                // from the anchor to the cursor while one is being selected.
+                std::set<std::string> taggedPosts;
+                std::string visualAnchor;
+                std::shared_ptr<const Categories> labels;
+                // Feeds are listed under the categories expanded, by label.
+                std::shared_ptr<const Subscriptions> subscriptions;
+                std::set<std::string> expandedCategories;
+                RequestId subscriptionsRequest{};
+                std::vector<PostData> posts;
+                PostStore postStore;
+                struct CachedStream{
+                        std::vector<PostData> posts;
+                        bool rank;
+                };
+                std::map<std::string, CachedStream> streamCache;
+                std::deque<std::string> prefetchQueue;
+                std::map<std::string, RequestId> prefetchRequests;
+                // Listed entries whose content is being fetched, see loadVisibleEntries().
+                std::set<std::string> entriesLoading;
+                std::vector<RequestId> entryRequests;
+                std::string currentCategory;
+                // The categories of every merged view by its label, from merged_categories.
+                std::map<std::string, std::vector<std::string>> mergedViews;
+                // The merged view on screen and the pages of it being fetched, by source.
+                std::unique_ptr<MergedStream> merged;
+                std::map<size_t, RequestId> pageRequests;
+                bool mergedShown{};
+                std::map<std::string, int> unreadCounts;
+                RequestId countsRequest{};
+                RequestId labelsRequest{};
+                bool startupReported{};
+                StreamPoller poller{std::chrono::steady_clock::now()};
+                std::map<std::string, RequestId> newPostsRequests;
+                // Saved posts whose articles are waiting to be downloaded, as id and URL.
+                ArticleCache articles;
+                std::deque<std::pair<std::string, std::string>> articleQueue;
+                std::map<std::string, RequestId> articleRequests;
+                FeedAnalytics analytics;
+                MENU *ctgMenu{}, *postsMenu{}, *curMenu{};
+                RequestId streamRequest{};
+                std::string statusLine[3], infoLine, postsMessage;
                 std::chrono::time_point<std::chrono::steady_clock> lastPostSelectionTime{std::chrono::time_point<std::chrono::steady_clock>::max()};
                 std::chrono::seconds secondsToMarkAsRead;
                 std::string textBrowser;
                 const std::filesystem::path previewPath;
+                // The preview as w3m rendered it, for the post and width it was rendered for.
+                std::string previewId, previewText;
+                int previewWidth{};
                 bool currentRank{};
+                SortMode sortMode{SortMode::NEWEST};
                 unsigned int totalPosts{};
                 unsigned int numUnread{};
                 int viewWinHeightPer = VIEW_WIN_HEIGHT_PER, viewWinHeight = 0, ctgWinWidth = CTG_WIN_WIDTH;
+                void applyConfig(const Config& config);
+                void reloadConfig();
+                void fetchLabels();
+                void reportInteractive();
+                void logStartupTime(const char* metric);
+                void layoutWindows();
+                void resizeWindows();
                 void clearCategoryItems();
                 void clearPostItems();
                 void createCategoriesMenu();
+                void fillCategoryItems();
+                std::string categoryName(const std::string& label, const std::string& id) const;
+                const std::string& categoryLabel(ITEM* item) const;
+                static bool isFeed(const std::string& label){
+                        return label.compare(0, 5, "feed/") == 0;
+                }
+                std::vector<const Subscription*> feedsOf(const std::string& label, const std::string& id) const;
+                void expandCategory(ITEM* item, bool expand);
+                void fetchSubscriptions();
+                void refreshUnreadCounts(Priority priority = Priority::INTERACTIVE);
+                static std::vector<std::string> countedStreams(const PostData& post);
+                void adjustUnreadCounts(const std::vector<std::string>& categoryIds, int delta, int posts = 1);
+                void runTimers();
                 void createPostsMenu();
                 void changeSelectedItem(MENU* curMenu, int req);
-                void ctgMenuCallback(const char* label);
+                void renderPreview(ITEM* curItem);
+                void handleKey(int ch);
+                void focusMenu(MENU* menu);
+                void ctgMenuCallback(const char* label, bool focusPosts);
+                void showPosts(std::vector<PostData>&& newPosts, const std::string& errorMessage, bool focusPosts, bool keepSelection);
+                void openMergedView(const std::string& label, bool focusPosts, bool keepSelection);
+                void requestMergedPage(size_t source, bool focusPosts, bool keepSelection);
+                void receiveMergedPage(size_t source, std::vector<PostData>&& page, const std::string& continuation,
+                                const std::string& error, bool focusPosts, bool keepSelection);
+                void loadMergedPages();
+                void closeMergedView();
+                void prefetchCategories();
+                void startPrefetches();
+                void cancelPrefetches();
+                void prefetchArticles(const std::vector<PostData>& saved);
+                void startArticleDownloads();
+                void cancelArticleDownloads();
+                std::string articleLocation(const PostData& post);
+                RequestId requestStream(const std::string& category, bool rank, PostsCallback callback, Priority priority = Priority::INTERACTIVE);
+                void loadVisibleEntries();
+                void fillEntries(std::vector<PostData>&& entries);
+                void fetchNewPosts(const std::string& label);
+                void mergeNewPosts(const std::string& label, std::vector<PostData>&& newPosts);
+                void relistPosts(const std::string& selectedId, int row);
+                void cancelEntryRequests();
+                void sortPosts();
+                void listPosts(const std::string& selectedId);
+                void syncPostItems();
+                std::vector<PostData> selectedPosts() const;
+                std::pair<int, int> visualRange() const;
+                void clearSelection();
+                void reportSelection();
+                void drawSelectionMarks();
+                void markSelectionRead(bool read);
+                void markSelectionSaved(bool saved);
+                void settleChange(ChangeId change, const std::string& error, const std::function<void()>& undo = std::function<void()>());
+                void markCategoryRead(const std::string& label, const std::string& id);
+                const PostData& postAt(ITEM* item) const;
                 void postsMenuCallback(ITEM* item, bool preview);
-                void markItemRead(ITEM* item);
+                void markItemRead(ITEM* item, bool opened = false);
                 void markItemReadAutomatically(ITEM* item);
                 void renderWindow(WINDOW *win, const char *label, int labelColor, bool highlight);
                 void printInMiddle(WINDOW *win, int starty, int startx, int width, const char *string, chtype color);
@@ -50,7 +192,14 @@ class CursesProvider{
                 void clear_statusline();
                 void update_statusline(const char* update, const char* post, bool showCounter);
                 void update_infoline(const char* info);
+                void drawStatusline();
+                void drawFrame();
+                void toggleStatsOverlay(bool feeds);
+                void placeStatsOverlay();
+                void renderStatsOverlay();
+                void renderFeedStats();
                 int execute(const std::string& command, const std::string& arg);
+                void reapChildren();
 };
 
 #endif
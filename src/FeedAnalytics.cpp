@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <tuple>
+
+#include <json/json.h>
+
+#include "FeedAnalytics.h"
+
+namespace fs = std::filesystem;
+
+FeedAnalytics::FeedAnalytics(const fs::path& path):
+        path{path}{
+}
+void FeedAnalytics::load(){
+        auto input = std::ifstream(path);
+        if(!input){
+                return;
+        }
+
+        Json::CharReaderBuilder builder;
+        Json::Value root;
+        std::string errors;
+        if(!Json::parseFromStream(builder, input, &root, &errors)){
+                throw std::runtime_error("Failed to parse " + path.native() + ": " + errors);
+        }
+
+        for(const auto& id : root.getMemberNames()){
+                const auto& feed = root[id];
+                auto& counters = feeds[id];
+                counters.title = feed["title"].asString();
+                counters.ingested = feed["ingested"].asUInt64();
+                counters.opened = feed["opened"].asUInt64();
+                counters.unopened = feed["unopened"].asUInt64();
+                counters.saved = feed["saved"].asUInt64();
+                counters.previewMs = feed["preview_ms"].asInt64();
+                counters.oldestCrawled = feed["oldest_crawled"].asInt64();
+                counters.newestCrawled = feed["newest_crawled"].asInt64();
+        }
+}
+void FeedAnalytics::save() const{
+        Json::Value root(Json::objectValue);
+        for(const auto& [id, counters] : feeds){
+                auto& feed = root[id];
+                feed["title"] = counters.title;
+                feed["ingested"] = static_cast<Json::UInt64>(counters.ingested);
+                feed["opened"] = static_cast<Json::UInt64>(counters.opened);
+                feed["unopened"] = static_cast<Json::UInt64>(counters.unopened);
+                feed["saved"] = static_cast<Json::UInt64>(counters.saved);
+                feed["preview_ms"] = static_cast<Json::Int64>(counters.previewMs);
+                feed["oldest_crawled"] = static_cast<Json::Int64>(counters.oldestCrawled);
+                feed["newest_crawled"] = static_cast<Json::Int64>(counters.newestCrawled);
+        }
+
+        fs::create_directories(path.parent_path());
+        auto partial = path;
+        partial += ".part";
+
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        if(auto output = std::ofstream(partial); !(output << Json::writeString(builder, root))){
+                throw std::runtime_error("Failed to write " + partial.native());
+        }
+
+        fs::rename(partial, path);
+}
+// The same posts come back with every refresh and prefetch. Instead of
+// remembering every id, a feed remembers the span of time of the posts it
+// counted, and a batch only counts the posts from outside it.
+void FeedAnalytics::recordIngested(const std::vector<PostData>& posts){
+        auto spans = std::unordered_map<FeedCounters*, std::pair<long long, long long>>{};
+        for(const auto& post : posts){
+                const auto counters = countersOf(post);
+                if(counters == NULL){
+                        continue;
+                }
+
+                const auto counted = (counters->newestCrawled != 0) && (post.crawled >= counters->oldestCrawled) && (post.crawled <= counters->newestCrawled);
+                if(!counted){
+                        counters->ingested++;
+                        counters->title = post.originTitle;
+                }
+
+                const auto [span, added] = spans.try_emplace(counters, post.crawled, post.crawled);
+                span->second.first = std::min(span->second.first, post.crawled);
+                span->second.second = std::max(span->second.second, post.crawled);
+        }
+
+        for(const auto& [counters, span] : spans){
+                const auto empty = (counters->newestCrawled == 0);
+                counters->oldestCrawled = empty ? span.first : std::min(counters->oldestCrawled, span.first);
+                counters->newestCrawled = empty ? span.second : std::max(counters->newestCrawled, span.second);
+        }
+}
+void FeedAnalytics::recordOpened(const PostData& post){
+        if(const auto counters = countersOf(post)){
+                counters->opened++;
+        }
+}
+void FeedAnalytics::recordUnopened(const PostData& post){
+        if(const auto counters = countersOf(post)){
+                counters->unopened++;
+        }
+}
+void FeedAnalytics::recordSaved(const PostData& post){
+        if(const auto counters = countersOf(post)){
+                counters->saved++;
+        }
+}
+void FeedAnalytics::recordPreview(const PostData& post, std::chrono::milliseconds shown){
+        if(const auto counters = countersOf(post)){
+                counters->previewMs += shown.count();
+        }
+}
+// Feeds that read least sort first by read rate; by everything else, most first.
+std::vector<std::pair<std::string, FeedCounters>> FeedAnalytics::sorted(FeedColumn column) const{
+        auto rows = std::vector<std::pair<std::string, FeedCounters>>(feeds.begin(), feeds.end());
+        const auto key = [column](const FeedCounters& counters) -> double{
+                switch(column){
+                        case FeedColumn::INGESTED:
+                                return counters.ingested;
+                        case FeedColumn::READ_RATE:
+                                return -counters.readRate();
+                        case FeedColumn::OPENED:
+                                return counters.opened;
+                        case FeedColumn::UNOPENED:
+                                return counters.unopened;
+                        case FeedColumn::SAVED:
+                                return counters.saved;
+                        case FeedColumn::PREVIEW:
+                                return counters.previewMs;
+                }
+
+                return 0;
+        };
+
+        std::sort(rows.begin(), rows.end(), [&key](const auto& a, const auto& b){
+                return std::make_tuple(key(a.second), a.second.ingested, b.first) > std::make_tuple(key(b.second), b.second.ingested, a.first);
+        });
+        return rows;
+}
+// Entries only known by their id yet belong to no feed.
+FeedCounters* FeedAnalytics::countersOf(const PostData& post){
+        if(post.feedId.empty()){
+                return NULL;
+        }
+
+        auto& counters = feeds[post.feedId];
+        if(counters.title.empty()){
+                counters.title = post.originTitle;
+        }
+
+        return &counters;
+}
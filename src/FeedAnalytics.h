@@ -0,0 +1,53 @@
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _FEED_ANALYTICS_H_
+#define _FEED_ANALYTICS_H_
+
+#include "FeedlyProvider.h"
+
+enum class FeedColumn{INGESTED, READ_RATE, OPENED, UNOPENED, SAVED, PREVIEW};
+
+struct FeedCounters{
+        std::string title;
+        unsigned long ingested{};
+        unsigned long opened{};
+        // Marked read without being opened.
+        unsigned long unopened{};
+        unsigned long saved{};
+        long long previewMs{};
+        // Posts crawled in this span have been counted as ingested.
+        long long oldestCrawled{};
+        long long newestCrawled{};
+        double readRate() const{
+                return (ingested > 0) ? static_cast<double>(opened) / ingested : 0;
+        }
+};
+
+// How much every feed publishes and how much of it gets read, kept as
+// running totals per feed. Each event updates one feed's counters, and
+// listing the feeds only sorts the totals. Kept in a JSON file between sessions.
+class FeedAnalytics{
+        public:
+                explicit FeedAnalytics(const std::filesystem::path& path);
+                // A missing file starts from zero; both throw on I/O or parse errors.
+                void load();
+                void save() const;
+                // posts must be all the entries of a feed within their span of time,
+                // as the feed's or a category's stream has them; not the saved ones.
+                void recordIngested(const std::vector<PostData>& posts);
+                void recordOpened(const PostData& post);
+                void recordUnopened(const PostData& post);
+                void recordSaved(const PostData& post);
+                void recordPreview(const PostData& post, std::chrono::milliseconds shown);
+                std::vector<std::pair<std::string, FeedCounters>> sorted(FeedColumn column) const;
+        private:
+                std::filesystem::path path;
+                std::unordered_map<std::string, FeedCounters> feeds;
+                FeedCounters* countersOf(const PostData& post);
+};
+
+#endif
@@ -8,49 +8,83 @@
 
 #include <iterator>
 #include <istream>
+#include <set>
+#include <sstream>
 #include <termios.h>
 #include <unistd.h>
+#include <chrono>
 #include <ctime>
+#include <thread>
 
 #include "FeedlyProvider.h"
+#include "Logger.h"
+#include "OpmlReader.h"
+#include "Tracer.h"
+#include "WorkerPool.h"
 
 namespace fs = std::filesystem;
 using namespace std::literals::string_literals;
-using FileStream = std::unique_ptr<FILE, decltype(&fclose)>;
 
-FeedlyProvider::FeedlyProvider(const fs::path& tmpDir):
-        tempPath{tmpDir / "temp.txt"}{
+static std::shared_ptr<const Subscriptions> parseSubscriptions(const Json::Value& root){
+        auto subscriptions = std::make_shared<Subscriptions>();
+        for(const auto& item : root){
+                auto subscription = Subscription{item["id"].asString(), item["title"].asString(), {}};
+                for(const auto& category : item["categories"]){
+                        subscription.categoryIds.push_back(category["id"].asString());
+                }
+
+                subscriptions->push_back(std::move(subscription));
+        }
+
+        return subscriptions;
+}
+
+FeedlyProvider::FeedlyProvider():
+        relevance{fs::path{getenv("HOME")} / ".local" / "share" / "feednix" / "relevance.json"},
+        subscriptionsPath{fs::path{getenv("HOME")} / ".cache" / "feednix" / "subscriptions.json"}{
 
         curl_global_init(CURL_GLOBAL_DEFAULT);
+        multi = curl_multi_init();
+
+        // Share one HTTP/2 connection between concurrent requests where possible.
+        curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, MAX_HOST_CONNECTIONS);
 
         const auto configRoot = fs::path{getenv("HOME")} / ".config" / "feednix";
         configPath = configRoot / "config.json";
-        logPath = configRoot / "log.txt";
 
-        Json::Value root;
-        Json::Reader reader;
+        // authenticateUser() reports the error; the UI never starts without a config.
+        try{
+                config = std::make_shared<const Config>(Config::load(configPath));
+        }
+        catch(const std::exception& e){
+                configError = e.what();
+        }
 
-        std::ifstream tokenFile(configPath.c_str(), std::ifstream::binary);
-        if(reader.parse(tokenFile, root)){
-                rtrv_count = root["posts_retrive_count"].asString();
+        // Ranking starts over rather than keeping feednix from starting.
+        try{
+                relevance.load();
+        }
+        catch(const std::exception& e){
+                Logger::warning(e.what());
+        }
+
+        try{
+                loadSubscriptions();
+        }
+        catch(const std::exception& e){
+                Logger::warning(e.what());
         }
-        tokenFile.close();
 }
 void FeedlyProvider::authenticateUser(){
-        Json::Value root;
-        Json::Reader reader;
-
-        std::ifstream initialConfig(configPath.c_str(), std::ifstream::binary);
-        bool parsingSuccesful = reader.parse(initialConfig, root);
+        TraceSpan span{"authenticateUser"};
 
-        if(!parsingSuccesful){
-                openLogStream();
-                log_stream << "ERROR: Log In Failed - Unable to read from config file" << std::endl;
-                log_stream << reader.getFormattedErrorMessages() << std::endl;
+        if(!config){
+                Logger::error("Log In Failed - Unable to read from config file: " + configError);
                 exit(EXIT_FAILURE);
         }
 
-        if(root["developer_token"] == Json::nullValue || changeTokens){
+        if(!config->hasDeveloperToken || changeTokens){
                 std::cout << "You will now be redirected to Feedly's Developer Log In page..." << std::endl;
                 std::cout << "Please sign in, copy your user id and retrive the token from your email and copy it onto here." << std::endl;
 
@@ -82,80 +116,183 @@ void FeedlyProvider::authenticateUser(){
                 std::cout << "[Enter token] >> ";
                 std::cin >> devToken;
 
-                root["developer_token"] = devToken;
-                root["userID"] = userID;
-
-                Json::StyledWriter writer;
+                auto updated = std::make_shared<Config>(*config);
+                updated->setCredentials(userID, devToken);
+                updated->save(configPath);
+                std::atomic_store(&config, std::shared_ptr<const Config>(std::move(updated)));
+        }
 
-                std::ofstream newConfig(configPath.c_str());
-                newConfig << root;
+        user_data.authToken = config->developerToken;
+        user_data.id = config->userId;
 
-                newConfig.close();
+        // The global streams are known without asking, so they can be fetched before the labels.
+        std::atomic_store(&user_data.categories, std::shared_ptr<const Categories>(builtinLabels()));
+}
+std::shared_ptr<const Config> FeedlyProvider::getConfig() const{
+        return std::atomic_load(&config);
+}
+// Parse config.json again. On failure the previous settings stay in effect.
+std::shared_ptr<const Config> FeedlyProvider::reloadConfig(){
+        auto reloaded = std::make_shared<const Config>(Config::load(configPath));
+        std::atomic_store(&config, reloaded);
+        return reloaded;
+}
+const std::filesystem::path& FeedlyProvider::getConfigPath() const{
+        return configPath;
+}
+std::shared_ptr<const Categories> FeedlyProvider::getLabels(){
+        try{
+                return storeLabels(curl_retrieve("categories"));
         }
-        initialConfig.close();
+        catch(const std::exception& e){
+                Logger::error("Could not get labels: "s + e.what());
+                throw;
+        }
+}
+RequestId FeedlyProvider::requestLabels(LabelsCallback callback){
+        return curl_retrieve_async("categories", Json::Value::nullSingleton(),
+                        [this, callback](const Json::Value& root, const std::string& error){
+                if(!error.empty()){
+                        Logger::error("Could not get labels: " + error);
+                        callback(getCachedLabels(), error);
+                        return;
+                }
 
-        user_data.authToken = (root["developer_token"]).asString();
-        user_data.id = (root["userID"]).asString();
+                callback(storeLabels(root), error);
+        });
 }
-const std::map<std::string, std::string>& FeedlyProvider::getLabels(){
-        user_data.categories.clear();
-        user_data.categories["All"] = "user/" + user_data.id + "/category/global.all";
-        user_data.categories["Saved"] = "user/" + user_data.id + "/tag/global.saved";
-        user_data.categories["Uncategorized"] = "user/" + user_data.id + "/category/global.uncategorized";
+// The subscriptions are kept on disk with their ETag and only sent again
+// when they changed since; otherwise Feedly answers 304 without a body.
+RequestId FeedlyProvider::requestSubscriptions(SubscriptionsCallback callback, Priority priority){
+        return curl_revalidate_async("subscriptions", subscriptions ? subscriptionsEtag : std::string{},
+                        [this, callback](const Json::Value& root, const std::string& etag, const std::string& error){
+                if(!error.empty()){
+                        Logger::error("Could not get subscriptions: " + error);
+                        callback(subscriptions, error);
+                        return;
+                }
 
-        try{
-                const auto root{ curl_retrieve("categories") };
-                for(const auto& item : root){
-                    user_data.categories[item["label"].asString()] = item["id"].asString();
+                if(!root.isNull()){
+                        subscriptions = parseSubscriptions(root);
+                        subscriptionsEtag = etag;
+                        try{
+                                saveSubscriptions(root);
+                        }
+                        catch(const std::exception& e){
+                                Logger::warning("Could not keep the subscriptions: "s + e.what());
+                        }
                 }
+
+                callback(subscriptions, error);
+        }, priority);
+}
+std::shared_ptr<const Subscriptions> FeedlyProvider::getCachedSubscriptions() const{
+        return subscriptions;
+}
+void FeedlyProvider::loadSubscriptions(){
+        auto input = std::ifstream(subscriptionsPath);
+        if(!input){
+                return;
         }
-        catch(const std::exception& e){
-                openLogStream();
-                log_stream << "Could not get labels" << std::endl;
-                log_stream << e.what() << std::endl;
-                throw;
+
+        Json::CharReaderBuilder builder;
+        Json::Value root;
+        std::string errors;
+        if(!Json::parseFromStream(builder, input, &root, &errors)){
+                throw std::runtime_error("Failed to parse " + subscriptionsPath.native() + ": " + errors);
         }
 
-        return user_data.categories;
+        subscriptions = parseSubscriptions(root["subscriptions"]);
+        subscriptionsEtag = root["etag"].asString();
 }
-CurlString FeedlyProvider::escapeCurlString(const std::string& s){
-        return CurlString(curl_easy_escape(curl, s.c_str(), 0), &curl_free);
+// Keep the subscriptions Feedly sent for the next session.
+void FeedlyProvider::saveSubscriptions(const Json::Value& root) const{
+        Json::Value document;
+        document["etag"] = subscriptionsEtag;
+        document["subscriptions"] = root;
+
+        fs::create_directories(subscriptionsPath.parent_path());
+        auto partial = subscriptionsPath;
+        partial += ".part";
+
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        if(auto output = std::ofstream(partial); !(output << Json::writeString(builder, document))){
+                throw std::runtime_error("Failed to write " + partial.native());
+        }
+
+        fs::rename(partial, subscriptionsPath);
+}
+// The labels known so far; only the global streams until the categories have been fetched.
+std::shared_ptr<const Categories> FeedlyProvider::getCachedLabels() const{
+        return std::atomic_load(&user_data.categories);
 }
-const std::vector<PostData>& FeedlyProvider::giveStreamPosts(const std::string& category, bool whichRank){
-        feeds.clear();
+std::shared_ptr<Categories> FeedlyProvider::builtinLabels() const{
+        auto categories = std::make_shared<Categories>();
+        (*categories)["All"] = "user/" + user_data.id + "/category/global.all";
+        (*categories)["Saved"] = "user/" + user_data.id + "/tag/global.saved";
+        (*categories)["Uncategorized"] = "user/" + user_data.id + "/category/global.uncategorized";
+        return categories;
+}
+std::shared_ptr<const Categories> FeedlyProvider::storeLabels(const Json::Value& root){
+        auto categories = builtinLabels();
+        for(const auto& item : root){
+            (*categories)[item["label"].asString()] = item["id"].asString();
+        }
 
+        std::atomic_store(&user_data.categories, std::shared_ptr<const Categories>(std::move(categories)));
+        return std::atomic_load(&user_data.categories);
+}
+// A feed is opened like a category, with its stream id as its label.
+std::string FeedlyProvider::categoryId(const std::string& label) const{
+        if(label.compare(0, 5, "feed/") == 0){
+                return label;
+        }
+
+        const auto categories = std::atomic_load(&user_data.categories);
+        if(categories){
+                if(const auto it = categories->find(label); it != categories->end()){
+                        return it->second;
+                }
+        }
+
+        return std::string();
+}
+CurlString FeedlyProvider::escapeCurlString(const std::string& s){
+        // curl_easy_escape() doesn't use the handle, so no shared one is needed.
+        return CurlString(curl_easy_escape(NULL, s.c_str(), 0), &curl_free);
+}
+std::string FeedlyProvider::streamUri(const std::string& category, bool whichRank){
         std::string rank = "newest";
         if(whichRank){
                 rank = "oldest";
         }
 
-        Json::Value root;
-        try{
-                if(category == "All"){
-                        const auto streamId = escapeCurlString(user_data.categories["All"]);
-                        root = curl_retrieve("streams/contents?ranked="s + rank + "&count=" + rtrv_count + "&unreadOnly=true&streamId=" + streamId.get());
-                }
-                else if(category == "Uncategorized"){
-                        const auto streamId = escapeCurlString(user_data.categories["Uncategorized"]);
-                        root = curl_retrieve("streams/contents?ranked="s + rank + "&count="s + rtrv_count + "&unreadOnly=true&streamId=" + streamId.get());
-                }
-                else if(category == "Saved"){
-                        const auto streamId = escapeCurlString(user_data.categories["Saved"]);
-                        root = curl_retrieve("streams/contents?ranked="s + rank + "&count="s + rtrv_count + "&unreadOnly=true&streamId=" + streamId.get());
-                }
-                else{
-                        const auto streamId = escapeCurlString(user_data.categories[category]);
-                        root = curl_retrieve("streams/"s + streamId.get() + "/contents?unreadOnly=true&ranked=newest&count="s + rtrv_count);
-                }
+        // Read on every request so an edited posts_retrive_count applies to the next fetch.
+        const auto rtrv_count = std::to_string(getConfig()->postsRetrieveCount);
+
+        if(category == "All"){
+                const auto streamId = escapeCurlString(categoryId("All"));
+                return "streams/contents?ranked="s + rank + "&count=" + rtrv_count + "&unreadOnly=true&streamId=" + streamId.get();
         }
-        catch(const std::exception& e){
-                openLogStream();
-                log_stream << "Could not get posts" << std::endl;
-                log_stream << e.what() << std::endl;
-                throw;
+        else if(category == "Uncategorized"){
+                const auto streamId = escapeCurlString(categoryId("Uncategorized"));
+                return "streams/contents?ranked="s + rank + "&count="s + rtrv_count + "&unreadOnly=true&streamId=" + streamId.get();
+        }
+        else if(category == "Saved"){
+                // Saved posts stay listed once read, so their articles are kept offline too.
+                const auto streamId = escapeCurlString(categoryId("Saved"));
+                return "streams/contents?ranked="s + rank + "&count="s + rtrv_count + "&streamId=" + streamId.get();
         }
 
-        for(const auto& item : root["items"]){
+        const auto streamId = escapeCurlString(categoryId(category));
+        return "streams/"s + streamId.get() + "/contents?unreadOnly=true&ranked="s + rank + "&count="s + rtrv_count;
+}
+std::vector<PostData> FeedlyProvider::ingestPosts(const Json::Value& items, const std::string& category){
+        TraceSpan span{"ingestPosts", category};
+
+        std::vector<PostData> feeds;
+        for(const auto& item : items){
                 auto url = std::string{};
                 for(const auto& alternate : item["alternate"]){
                         if(alternate["type"].asString() == "text/html"){
@@ -164,17 +301,144 @@ const std::vector<PostData>& FeedlyProvider::giveStreamPosts(const std::string&
                         }
                 }
 
+                auto categoryIds = std::vector<std::string>{};
+                for(const auto& category : item["categories"]){
+                        categoryIds.push_back(category["id"].asString());
+                }
+
+                // Tag ids look like "user/<id>/tag/global.saved".
+                const auto savedTag = "/tag/global.saved"s;
+                auto saved = false;
+                for(const auto& tag : item["tags"]){
+                        const auto tagId = tag["id"].asString();
+                        saved = saved || ((tagId.length() >= savedTag.length()) &&
+                                        (tagId.compare(tagId.length() - savedTag.length(), savedTag.length(), savedTag) == 0));
+                }
+
                 feeds.push_back({
                     item["summary"]["content"].asString(),
                     item["title"].asString(),
                     item["id"].asString(),
                     url,
-                    item["origin"]["title"].asString()});
+                    item["origin"]["title"].asString(),
+                    categoryIds,
+                    item.get("unread", true).asBool(),
+                    saved,
+                    item["published"].asInt64(),
+                    item["crawled"].asInt64(),
+                    item["engagement"].asInt(),
+                    item["origin"]["streamId"].asString(),
+                    true,
+                    0,
+                    {}});
         }
 
+        relevance.score(feeds);
         return feeds;
 }
-void FeedlyProvider::markPostsRead(const std::vector<std::string>& ids){
+RequestId FeedlyProvider::requestStreamPosts(const std::string& category, bool whichRank, PostsCallback callback, Priority priority){
+        return curl_retrieve_async(streamUri(category, whichRank), Json::Value::nullSingleton(),
+                        [this, category, callback](const Json::Value& root, const std::string& error){
+                if(!error.empty()){
+                        Logger::error("Could not get posts: " + error);
+                        callback({}, error);
+                        return;
+                }
+
+                callback(ingestPosts(root["items"], category), error);
+        }, priority);
+}
+// One page of a stream; an empty continuation asks for the first one.
+RequestId FeedlyProvider::requestStreamPage(const std::string& category, bool whichRank, const std::string& continuation, StreamPageCallback callback, Priority priority){
+        auto uri = streamUri(category, whichRank);
+        if(!continuation.empty()){
+                uri += "&continuation="s + escapeCurlString(continuation).get();
+        }
+
+        return curl_retrieve_async(uri, Json::Value::nullSingleton(),
+                        [this, category, callback](const Json::Value& root, const std::string& error){
+                if(!error.empty()){
+                        Logger::error("Could not get posts: " + error);
+                        callback({}, "", error);
+                        return;
+                }
+
+                callback(ingestPosts(root["items"], category), root["continuation"].asString(), error);
+        }, priority);
+}
+// The unread entries crawled after newerThan, in milliseconds since the epoch.
+RequestId FeedlyProvider::requestNewerPosts(const std::string& category, long long newerThan, PostsCallback callback, Priority priority){
+        return curl_retrieve_async(streamUri(category, false) + "&newerThan=" + std::to_string(newerThan), Json::Value::nullSingleton(),
+                        [this, category, callback](const Json::Value& root, const std::string& error){
+                if(!error.empty()){
+                        Logger::error("Could not get new posts: " + error);
+                        callback({}, error);
+                        return;
+                }
+
+                callback(ingestPosts(root["items"], category), error);
+        }, priority);
+}
+// The ids of a stream's unread entries, or of every saved one, without their content.
+RequestId FeedlyProvider::requestStreamIds(const std::string& category, bool whichRank, IdsCallback callback, Priority priority){
+        const auto streamId = escapeCurlString(categoryId(category));
+        const auto uri = "streams/ids?streamId="s + streamId.get()
+                + "&count=" + std::to_string(getConfig()->postsRetrieveCount)
+                + ((category == "Saved") ? "" : "&unreadOnly=true")
+                + "&ranked=" + (whichRank ? "oldest" : "newest");
+        return curl_retrieve_async(uri, Json::Value::nullSingleton(),
+                        [this, callback](const Json::Value& root, const std::string& error){
+                if(!error.empty()){
+                        Logger::error("Could not get entry ids: " + error);
+                        callback({}, error);
+                        return;
+                }
+
+                std::vector<std::string> ids;
+                for(const auto& id : root["ids"]){
+                        ids.push_back(id.asString());
+                }
+
+                callback(std::move(ids), error);
+        }, priority);
+}
+// Full entries for the given ids, fetched in a single request.
+RequestId FeedlyProvider::requestEntries(const std::vector<std::string>& ids, PostsCallback callback){
+        Json::Value jsonCont(Json::arrayValue);
+        for(const auto& id : ids){
+                jsonCont.append(id);
+        }
+
+        return curl_retrieve_async("entries/.mget", jsonCont,
+                        [this, callback](const Json::Value& root, const std::string& error){
+                if(!error.empty()){
+                        Logger::error("Could not get entries: " + error);
+                        callback({}, error);
+                        return;
+                }
+
+                callback(ingestPosts(root, "entries"), error);
+        });
+}
+// Unread counts of every category, tag and feed keyed by stream id.
+RequestId FeedlyProvider::requestUnreadCounts(CountsCallback callback, Priority priority){
+        return curl_retrieve_async("markers/counts", Json::Value::nullSingleton(),
+                        [this, callback](const Json::Value& root, const std::string& error){
+                if(!error.empty()){
+                        Logger::error("Could not get unread counts: " + error);
+                        callback({}, error);
+                        return;
+                }
+
+                std::map<std::string, UnreadCount> counts;
+                for(const auto& count : root["unreadcounts"]){
+                        counts[count["id"].asString()] = {count["count"].asInt(), count["updated"].asInt64()};
+                }
+
+                callback(std::move(counts), error);
+        }, priority);
+}
+void FeedlyProvider::markPostsRead(const std::vector<std::string>& ids, ErrorCallback onDone){
         Json::Value jsonCont;
         Json::Value array;
 
@@ -187,17 +451,9 @@ void FeedlyProvider::markPostsRead(const std::vector<std::string>& ids){
         jsonCont["entryIds"] = array;
         jsonCont["action"] = "markAsRead";
 
-        try{
-                curl_retrieve("markers", jsonCont);
-        }
-        catch(const std::exception& e){
-                openLogStream();
-                log_stream << "Could not mark post(s) as read" << std::endl;
-                log_stream << e.what() << std::endl;
-                throw;
-        }
+        postMarkers(jsonCont, "Could not mark post(s) as read", onDone);
 }
-void FeedlyProvider::markPostsUnread(const std::vector<std::string>& ids){
+void FeedlyProvider::markPostsUnread(const std::vector<std::string>& ids, ErrorCallback onDone){
         Json::Value jsonCont;
         Json::Value array;
 
@@ -210,17 +466,9 @@ void FeedlyProvider::markPostsUnread(const std::vector<std::string>& ids){
         jsonCont["entryIds"] = array;
         jsonCont["action"] = "keepUnread";
 
-        try{
-                curl_retrieve("markers", jsonCont);
-        }
-        catch(const std::exception& e){
-                openLogStream();
-                log_stream << "Could not mark post(s) as unread" << std::endl;
-                log_stream << e.what() << std::endl;
-                throw;
-        }
+        postMarkers(jsonCont, "Could not mark post(s) as unread", onDone);
 }
-void FeedlyProvider::markPostsSaved(const std::vector<std::string>& ids){
+void FeedlyProvider::markPostsSaved(const std::vector<std::string>& ids, ErrorCallback onDone){
         Json::Value jsonCont;
         Json::Value array;
 
@@ -233,17 +481,9 @@ void FeedlyProvider::markPostsSaved(const std::vector<std::string>& ids){
         jsonCont["entryIds"] = array;
         jsonCont["action"] = "markAsSaved";
 
-        try{
-                curl_retrieve("markers", jsonCont);
-        }
-        catch(const std::exception& e){
-                openLogStream();
-                log_stream << "Could not mark post(s) as saved" << std::endl;
-                log_stream << e.what() << std::endl;
-                throw;
-        }
+        postMarkers(jsonCont, "Could not mark post(s) as saved", onDone);
 }
-void FeedlyProvider::markPostsUnsaved(const std::vector<std::string>& ids){
+void FeedlyProvider::markPostsUnsaved(const std::vector<std::string>& ids, ErrorCallback onDone){
         Json::Value jsonCont;
         Json::Value array;
 
@@ -256,135 +496,661 @@ void FeedlyProvider::markPostsUnsaved(const std::vector<std::string>& ids){
         jsonCont["entryIds"] = array;
         jsonCont["action"] = "markAsUnsaved";
 
-        try{
-                curl_retrieve("markers", jsonCont);
-        }
-        catch(const std::exception& e){
-                openLogStream();
-                log_stream << "Could not mark post(s) as unsaved" << std::endl;
-                log_stream << e.what() << std::endl;
-                throw;
-        }
+        postMarkers(jsonCont, "Could not mark post(s) as unsaved", onDone);
 }
-void FeedlyProvider::markCategoriesRead(const std::string& id, const std::string& lastReadEntryId){
+void FeedlyProvider::markCategoriesRead(const std::string& id, const std::string& lastReadEntryId, ErrorCallback onDone){
         Json::Value jsonCont;
         Json::Value array;
 
-        jsonCont["type"] = "categories";
+        const auto feed = (id.compare(0, 5, "feed/") == 0);
+        jsonCont["type"] = feed ? "feeds" : "categories";
 
         array.append("categoryIds") = id;
 
-        jsonCont["lastReadEntryId"] = lastReadEntryId;
-        jsonCont["categoryIds"] = array;
+        // Without a loaded entry, everything published until now is read.
+        if(lastReadEntryId.empty()){
+                const auto now = std::chrono::system_clock::now().time_since_epoch();
+                jsonCont["asOf"] = static_cast<Json::Int64>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+        }
+        else{
+                jsonCont["lastReadEntryId"] = lastReadEntryId;
+        }
+
+        jsonCont[feed ? "feedIds" : "categoryIds"] = array;
         jsonCont["action"] = "markAsRead";
 
+        postMarkers(jsonCont, "Could not mark category(ies) as read", onDone);
+}
+void FeedlyProvider::postMarkers(const Json::Value& jsonCont, const std::string& failure, ErrorCallback onDone){
+        curl_retrieve_async("markers", jsonCont, [this, failure, onDone](const Json::Value&, const std::string& error){
+                if(!error.empty()){
+                        Logger::error(failure + ": " + error);
+                }
+
+                if(onDone){
+                        onDone(error);
+                }
+        });
+}
+void FeedlyProvider::addSubscription(bool newCategory, const std::string& feed, std::vector<std::string> categories, const std::string& title){
         try{
-                curl_retrieve("markers", jsonCont);
+                curl_retrieve("subscriptions", subscriptionJson("feed/" + feed, categories, title));
         }
         catch(const std::exception& e){
-                openLogStream();
-                log_stream << "Could not mark category(ies) as read" << std::endl;
-                log_stream << e.what() << std::endl;
+                Logger::error("Could not add subscription: "s + e.what());
                 throw;
         }
 }
-void FeedlyProvider::addSubscription(bool newCategory, const std::string& feed, std::vector<std::string> categories, const std::string& title){
-        int i = 0;
 
-        Json::Value jsonCont;
-        Json::Value array;
+// Subscribe to the feeds of an OPML file, several at a time on worker
+// threads. Feeds already subscribed to are skipped; categories that don't
+// exist yet are created by the subscriptions that name them.
+ImportReport FeedlyProvider::importOpml(const std::filesystem::path& path){
+        std::ifstream file(path);
+        if(!file){
+                throw std::runtime_error("Unable to open " + path.native());
+        }
 
-        jsonCont["id"] = "feed/" + feed;
-        jsonCont["title"] = title;
+        const auto known = getLabels();
+        auto subscribed = std::set<std::string>{};
+        for(const auto& subscription : curl_retrieve("subscriptions")){
+                subscribed.insert(subscription["id"].asString());
+        }
 
-        if(!categories.empty()){
-                for(const auto& category : categories){
-                        jsonCont["categories"][i]["id"] = user_data.categories[category];
-                        jsonCont["categories"][i]["label"] = category;
-                        i++;
+        Logger::info("Importing " + path.native());
+
+        // Only the import runs requests on threads of their own.
+        auto workers = WorkerPool(WORKER_THREADS);
+        auto report = ImportReport{};
+        auto inFlight = std::deque<std::pair<std::string, std::future<Json::Value>>>{};
+        const auto finishOne = [this, &report, &inFlight]{
+                auto [feedId, result] = std::move(inFlight.front());
+                inFlight.pop_front();
+                try{
+                        result.get();
+                        report.subscribed++;
+                        Logger::info("import subscribed " + feedId);
+                }
+                catch(const std::exception& e){
+                        report.failed++;
+                        Logger::error("import failed " + feedId + ": " + e.what());
                 }
-        }
-        else{
-                jsonCont["categories"] = Json::Value(Json::arrayValue);
-        }
 
-        try{
-                curl_retrieve("subscriptions", jsonCont);
+                std::cout << "\r" << report.subscribed << " subscribed, " << report.skipped << " skipped, " << report.failed << " failed" << std::flush;
+        };
+
+        auto reader = OpmlReader(file);
+        auto created = std::set<std::string>{};
+        for(auto feed = OpmlFeed{}; reader.next(feed);){
+                const auto feedId = "feed/" + feed.url;
+                if(!subscribed.insert(feedId).second){
+                        report.skipped++;
+                        Logger::info("import skipped " + feedId + ": already subscribed");
+                        continue;
+                }
+
+                for(const auto& label : feed.categories){
+                        if((known->count(label) == 0) && created.insert(label).second){
+                                Logger::info("import creates category " + label);
+                        }
+                }
+
+                // Bound the queue so a huge file doesn't turn into as many pending requests.
+                if(inFlight.size() >= MAX_IMPORTS_IN_FLIGHT){
+                        finishOne();
+                }
+
+                inFlight.emplace_back(feedId, workers.submit([this, json = subscriptionJson(feedId, feed.categories, feed.title)]{
+                        return curl_retrieve("subscriptions", json);
+                }));
         }
-        catch(const std::exception& e){
-                openLogStream();
-                log_stream << "Could not add subscription" << std::endl;
-                log_stream << e.what() << std::endl;
-                throw;
+
+        while(!inFlight.empty()){
+                finishOne();
         }
-}
 
-PostData& FeedlyProvider::getSinglePostData(int index){
-        return feeds.at(index);
+        std::cout << std::endl;
+        Logger::info("Imported " + path.native() + ": " + std::to_string(report.subscribed) + " subscribed, "
+                + std::to_string(report.skipped) + " skipped, " + std::to_string(report.failed) + " failed");
+        return report;
 }
+// A category that doesn't exist yet is created under the id Feedly expects.
+Json::Value FeedlyProvider::subscriptionJson(const std::string& feedId, const std::vector<std::string>& categories, const std::string& title) const{
+        Json::Value jsonCont;
+        jsonCont["id"] = feedId;
+        jsonCont["title"] = title;
+        jsonCont["categories"] = Json::Value(Json::arrayValue);
+        for(const auto& category : categories){
+                auto id = categoryId(category);
+                if(id.empty()){
+                        id = "user/" + user_data.id + "/category/" + category;
+                }
 
+                Json::Value entry;
+                entry["id"] = id;
+                entry["label"] = category;
+                jsonCont["categories"].append(entry);
+        }
+
+        return jsonCont;
+}
 const std::string FeedlyProvider::getUserId(){
         return user_data.id;
 }
 
-void FeedlyProvider::enableVerbose(){
-        if(verboseFlag)
-                curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
+const NetworkStats& FeedlyProvider::getNetworkStats() const{
+        return networkStats;
 }
+RelevanceModel& FeedlyProvider::getRelevance(){
+        return relevance;
+}
+
 void FeedlyProvider::setVerbose(bool value){
         verboseFlag = value;
 }
 void FeedlyProvider::setChangeTokensFlag(bool value){
         changeTokens = value;
 }
+static size_t appendToString(char* data, size_t size, size_t count, void* userdata){
+        static_cast<std::string*>(userdata)->append(data, size * count);
+        return size * count;
+}
+static size_t readHeader(char* data, size_t size, size_t count, void* userdata){
+        static_cast<RateLimitHeaders*>(userdata)->parse(data, size * count);
+        return size * count;
+}
+// Markers are worth waiting for longer than a list the user may have left already.
+static std::chrono::seconds deadlineFor(Priority priority, bool isPost){
+        if(priority == Priority::BACKGROUND){
+                return std::chrono::seconds(BACKGROUND_DEADLINE_SECONDS);
+        }
+
+        return std::chrono::seconds(isPost ? MARKER_DEADLINE_SECONDS : INTERACTIVE_DEADLINE_SECONDS);
+}
+static void setTimeout(CURL* handle, RateLimiter::Clock::time_point deadline, RateLimiter::Clock::time_point now){
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, static_cast<long>(std::max<long long>(left, 1)));
+}
+// Stop reading pages larger than MAX_PAGE_BYTES; curl then fails the transfer.
+static size_t appendToPage(char* data, size_t size, size_t count, void* userdata){
+        const auto page = static_cast<std::string*>(userdata);
+        if(page->size() + size * count > MAX_PAGE_BYTES){
+                return 0;
+        }
+
+        page->append(data, size * count);
+        return size * count;
+}
+CURL* FeedlyProvider::createHandle(const std::string& uri, const Json::Value& jsonCont, struct curl_slist*& headers){
+        headers = curl_slist_append(headers, ("Authorization: OAuth " + user_data.authToken).c_str());
+
+        auto handle = newHandle(std::string(FEEDLY_URI) + uri);
+        if(!jsonCont.isNull()){
+                Json::StyledWriter writer;
+                std::string document = writer.write(jsonCont);
+                curl_easy_setopt(handle, CURLOPT_POST, true);
+                curl_easy_setopt(handle, CURLOPT_COPYPOSTFIELDS, document.c_str());
+                headers = curl_slist_append(headers, "Content-Type: application/json");
+        }
+
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
+        return handle;
+}
+CURL* FeedlyProvider::newHandle(const std::string& url){
+        auto handle = curl_easy_init();
+        curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, true);
+        curl_easy_setopt(handle, CURLOPT_AUTOREFERER, true);
+        curl_easy_setopt(handle, CURLOPT_USERAGENT, "Mozilla/4.0");
+        curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+
+        // The overall limit is the request's deadline, set when it starts. These catch
+        // connections that stall before it; no signals, as worker threads use handles too.
+        curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, static_cast<long>(CONNECT_TIMEOUT_SECONDS));
+        curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT, static_cast<long>(LOW_SPEED_LIMIT_BYTES));
+        curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME, static_cast<long>(LOW_SPEED_TIME_SECONDS));
+
+        if(verboseFlag)
+                curl_easy_setopt(handle, CURLOPT_VERBOSE, 1);
+
+        return handle;
+}
 Json::Value FeedlyProvider::curl_retrieve(const std::string& uri, const Json::Value& jsonCont){
+        TraceSpan span{"curl_retrieve", uri};
         struct curl_slist *chunk = NULL;
 
         const auto isPost = !jsonCont.isNull();
-        if(const auto dataHolder = FileStream(fopen(tempPath.c_str(), "wb"), &fclose)){
-                chunk = curl_slist_append(chunk, ("Authorization: OAuth " + user_data.authToken).c_str());
-
-                curl = curl_easy_init();
-                curl_easy_setopt(curl, CURLOPT_URL, (std::string(FEEDLY_URI) + uri).c_str());
-                curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, true);
-                curl_easy_setopt(curl, CURLOPT_AUTOREFERER, true);
-                curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/4.0");
-                curl_easy_setopt(curl, CURLOPT_WRITEDATA, dataHolder.get());
-                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, chunk);
+        const auto handle = std::unique_ptr<CURL, decltype(&curl_easy_cleanup)>(createHandle(uri, jsonCont, chunk), &curl_easy_cleanup);
+        const auto headers = std::unique_ptr<curl_slist, decltype(&curl_slist_free_all)>(chunk, &curl_slist_free_all);
+
+        std::string response;
+        RateLimitHeaders rateHeaders;
+        curl_easy_setopt(handle.get(), CURLOPT_WRITEFUNCTION, appendToString);
+        curl_easy_setopt(handle.get(), CURLOPT_WRITEDATA, &response);
+        curl_easy_setopt(handle.get(), CURLOPT_HEADERFUNCTION, readHeader);
+        curl_easy_setopt(handle.get(), CURLOPT_HEADERDATA, &rateHeaders);
+
+        const auto deadline = RateLimiter::Clock::now() + deadlineFor(Priority::INTERACTIVE, isPost);
+        for(unsigned int attempt = 0;; attempt++){
+                auto now = RateLimiter::Clock::now();
+                for(; !limiter.tryAcquire(Priority::INTERACTIVE, now); now = RateLimiter::Clock::now()){
+                        const auto slot = limiter.nextSlot(Priority::INTERACTIVE, now);
+                        if(slot >= deadline){
+                                throw std::runtime_error("Timed out waiting to send " + uri);
+                        }
 
-                if(isPost){
-                        Json::StyledWriter writer;
-                        std::string document = writer.write(jsonCont);
-                        curl_easy_setopt(curl, CURLOPT_POST, true);
-                        curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, document.c_str());
-                        chunk = curl_slist_append(chunk, "Content-Type: application/json");
+                        std::this_thread::sleep_until(slot);
                 }
 
-                enableVerbose();
+                setTimeout(handle.get(), deadline, now);
+                response.clear();
+                rateHeaders = RateLimitHeaders{};
+                const auto result = curl_easy_perform(handle.get());
+                if(result != CURLE_OK){
+                        throw std::runtime_error("curl_easy_perform() failed: "s + curl_easy_strerror(result));
+                }
 
-                curl_res = curl_easy_perform(curl);
-                if(curl_res != CURLE_OK){
-                        throw std::runtime_error("curl_easy_perform() failed: "s + curl_easy_strerror(curl_res));
+                auto delay = RateLimiter::Clock::duration{};
+                if(checkRetry(handle.get(), uri, rateHeaders, attempt, deadline, delay)){
+                        std::this_thread::sleep_for(delay);
+                        continue;
                 }
+
+                std::istringstream data(response);
+                return parseResponse(handle.get(), uri, isPost, data);
+        }
+}
+RequestId FeedlyProvider::curl_retrieve_async(const std::string& uri, const Json::Value& jsonCont, ResponseCallback callback, Priority priority){
+        auto request = newRequest(uri, jsonCont, priority);
+        request->callback = std::move(callback);
+        return enqueueRequest(std::move(request));
+}
+// A GET sent with If-None-Match when there is an ETag to match.
+RequestId FeedlyProvider::curl_revalidate_async(const std::string& uri, const std::string& etag, RevalidateCallback callback, Priority priority){
+        auto request = newRequest(uri, Json::Value::nullSingleton(), priority);
+        if(!etag.empty()){
+                request->headers = curl_slist_append(request->headers, ("If-None-Match: " + etag).c_str());
+                curl_easy_setopt(request->handle, CURLOPT_HTTPHEADER, request->headers);
+        }
+
+        request->revalidateCallback = std::move(callback);
+        return enqueueRequest(std::move(request));
+}
+std::unique_ptr<FeedlyProvider::PendingRequest> FeedlyProvider::newRequest(const std::string& uri, const Json::Value& jsonCont, Priority priority){
+        auto request = std::make_unique<PendingRequest>();
+        request->uri = uri;
+        request->isPost = !jsonCont.isNull();
+        request->headers = NULL;
+        request->handle = createHandle(uri, jsonCont, request->headers);
+        request->priority = priority;
+        request->deadline = RateLimiter::Clock::now() + deadlineFor(priority, request->isPost);
+
+        curl_easy_setopt(request->handle, CURLOPT_WRITEFUNCTION, appendToString);
+        curl_easy_setopt(request->handle, CURLOPT_WRITEDATA, &request->response);
+        curl_easy_setopt(request->handle, CURLOPT_HEADERFUNCTION, readHeader);
+        curl_easy_setopt(request->handle, CURLOPT_HEADERDATA, &request->rateHeaders);
+        return request;
+}
+RequestId FeedlyProvider::enqueueRequest(std::unique_ptr<PendingRequest> request){
+        const auto id = nextRequestId++;
+        curl_easy_setopt(request->handle, CURLOPT_PRIVATE, reinterpret_cast<void*>(id));
+
+        pendingRequests[id] = std::move(request);
+        waitingRequests.push_back(id);
+        dispatchRequests();
+        return id;
+}
+void FeedlyProvider::completeRequest(PendingRequest& request, const Json::Value& root, const std::string& error){
+        if(request.revalidateCallback){
+                request.revalidateCallback(root, request.rateHeaders.etag, error);
         }
         else{
-                throw std::runtime_error("Failed to open the temporary file stream: "s + strerror(errno));
+                request.callback(root, error);
         }
+}
+// Pages come from other sites than Feedly: they go out at once, without
+// the token and the rate limiter, and their body is handed over as is.
+RequestId FeedlyProvider::requestPage(const std::string& url, PageCallback callback){
+        auto request = std::make_unique<PendingRequest>();
+        request->uri = url;
+        request->isPost = false;
+        request->headers = NULL;
+        request->handle = newHandle(url);
+        request->pageCallback = std::move(callback);
+        request->priority = Priority::BACKGROUND;
+        request->started = RateLimiter::Clock::now();
+        request->deadline = request->started + std::chrono::seconds(BACKGROUND_DEADLINE_SECONDS);
+        request->active = true;
+
+        const auto id = nextRequestId++;
+        curl_easy_setopt(request->handle, CURLOPT_ACCEPT_ENCODING, "");
+        curl_easy_setopt(request->handle, CURLOPT_WRITEFUNCTION, appendToPage);
+        curl_easy_setopt(request->handle, CURLOPT_WRITEDATA, &request->response);
+        curl_easy_setopt(request->handle, CURLOPT_PRIVATE, reinterpret_cast<void*>(id));
+        setTimeout(request->handle, request->deadline, request->started);
+
+        curl_multi_add_handle(multi, request->handle);
+        pendingRequests[id] = std::move(request);
+        return id;
+}
+// Start the waiting requests the rate limiter lets through, interactive
+// ones first and each priority in the order the requests were made.
+void FeedlyProvider::dispatchRequests(){
+        const auto now = RateLimiter::Clock::now();
+        for(const auto priority : {Priority::INTERACTIVE, Priority::BACKGROUND}){
+                for(auto it = waitingRequests.begin(); it != waitingRequests.end();){
+                        auto& request = *pendingRequests.at(*it);
+                        if((request.priority != priority) || (request.notBefore > now) || (request.deadline <= now)){
+                                ++it;
+                                continue;
+                        }
 
-        curl_easy_cleanup(curl);
+                        if(!limiter.tryAcquire(priority, now)){
+                                break;
+                        }
 
-        if(isPost){
-                return Json::Value();
+                        if(request.attempts == 0){
+                                request.started = now;
+                        }
+
+                        // Hedge once the first attempt takes longer than the configured
+                        // share of the endpoint's recent transfers did.
+                        const auto percentile = getConfig()->hedgePercentile;
+                        if(!request.isPost && !request.hedged && (percentile > 0)){
+                                const auto latency = networkStats.totalPercentile(NetworkStats::endpointOf(request.uri), percentile, MIN_HEDGE_SAMPLES);
+                                if(latency >= 0){
+                                        request.hedgeAt = now + std::max<RateLimiter::Clock::duration>(std::chrono::microseconds(latency), std::chrono::milliseconds(MIN_HEDGE_DELAY_MS));
+                                }
+                        }
+
+                        setTimeout(request.handle, request.deadline, now);
+                        request.active = true;
+                        curl_multi_add_handle(multi, request.handle);
+                        it = waitingRequests.erase(it);
+                }
+        }
+}
+// Pass the quota a response reported on to the limiter and tell whether the
+// request should be retried after delay: Feedly answers 429 when the quota
+// is exhausted and 5xx on errors that tend to go away.
+bool FeedlyProvider::checkRetry(CURL* handle, const std::string& uri, const RateLimitHeaders& headers, unsigned int attempt,
+                RateLimiter::Clock::time_point deadline, RateLimiter::Clock::duration& delay){
+        const auto now = RateLimiter::Clock::now();
+        limiter.update(headers, now);
+
+        long status;
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+        if(((status != 429) && (status < 500)) || (attempt >= MAX_RETRIES)){
+                return false;
+        }
+
+        delay = limiter.retryDelay(attempt, status, headers, now);
+        if(now + delay >= deadline){
+                return false;
         }
 
-        std::ifstream data(tempPath.c_str(), std::ifstream::binary);
-        if(!data){
-                throw std::runtime_error("Failed to open a temporary file: " + tempPath.native());
+        recordTiming(handle, uri, 0);
+        Logger::warning("Retrying " + uri + " after HTTP " + std::to_string(status) + " in "
+                + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(delay).count()) + " ms");
+        return true;
+}
+void FeedlyProvider::cancelRequest(RequestId id){
+        const auto it = pendingRequests.find(id);
+        if(it == pendingRequests.end()){
+                return;
+        }
+
+        waitingRequests.erase(std::remove(waitingRequests.begin(), waitingRequests.end(), id), waitingRequests.end());
+        if(it->second->hedge != NULL){
+                curl_multi_remove_handle(multi, it->second->hedge);
+                curl_easy_cleanup(it->second->hedge);
+        }
+
+        // The original attempt is gone when it failed while its hedge runs.
+        if(it->second->handle != NULL){
+                curl_multi_remove_handle(multi, it->second->handle);
+                curl_easy_cleanup(it->second->handle);
+        }
+
+        curl_slist_free_all(it->second->headers);
+        pendingRequests.erase(it);
+}
+bool FeedlyProvider::hasPendingRequests() const{
+        return !pendingRequests.empty();
+}
+// Block until one of fds becomes ready, a transfer needs attention or the timeout expires.
+void FeedlyProvider::waitForEvents(std::vector<curl_waitfd>& fds, int timeoutMs){
+        for(auto& fd : fds){
+                fd.revents = 0;
+        }
+
+        // Wake up when the rate limiter lets the next waiting request start,
+        // a waiting request expires or a running one is due for a hedge.
+        const auto now = RateLimiter::Clock::now();
+        const auto wakeAt = [&timeoutMs, now](RateLimiter::Clock::time_point time){
+                const auto wait = std::chrono::ceil<std::chrono::milliseconds>(time - now).count();
+                timeoutMs = std::max<int>(0, std::min<long long>(timeoutMs, wait));
+        };
+
+        for(const auto& [id, request] : pendingRequests){
+                if(request->active){
+                        if(!request->hedged){
+                                wakeAt(request->hedgeAt);
+                        }
+                }
+                else{
+                        wakeAt(std::min(request->deadline, std::max(request->notBefore, limiter.nextSlot(request->priority, now))));
+                }
+        }
+
+        curl_multi_poll(multi, fds.data(), fds.size(), timeoutMs, NULL);
+}
+// Run the callbacks of finished transfers and return how many there were.
+size_t FeedlyProvider::processEvents(){
+        dispatchRequests();
+
+        int running;
+        curl_multi_perform(multi, &running);
+        startHedges();
+
+        size_t completed = 0;
+        int queued;
+        while(const auto message = curl_multi_info_read(multi, &queued)){
+                if(message->msg != CURLMSG_DONE){
+                        continue;
+                }
+
+                char* privateData;
+                curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &privateData);
+                const auto id = reinterpret_cast<RequestId>(privateData);
+                const auto result = message->data.result;
+
+                const auto it = pendingRequests.find(id);
+                if(it == pendingRequests.end()){
+                        continue;
+                }
+
+                // Of a hedged pair the first attempt to answer wins. A failed
+                // attempt is dropped while the other one is still running.
+                auto& current = *it->second;
+                if(current.hedge != NULL){
+                        const auto fromHedge = (message->easy_handle == current.hedge);
+                        const auto other = fromHedge ? current.handle : current.hedge;
+                        if((result != CURLE_OK) && (other != NULL)){
+                                curl_multi_remove_handle(multi, message->easy_handle);
+                                curl_easy_cleanup(message->easy_handle);
+                                (fromHedge ? current.hedge : current.handle) = NULL;
+                                continue;
+                        }
+
+                        if(other != NULL){
+                                curl_multi_remove_handle(multi, other);
+                                curl_easy_cleanup(other);
+                        }
+
+                        if(fromHedge){
+                                current.handle = current.hedge;
+                                std::swap(current.response, current.hedgeResponse);
+                                std::swap(current.rateHeaders, current.hedgeHeaders);
+                                current.hedgeWon = (result == CURLE_OK);
+                        }
+
+                        current.hedge = NULL;
+                }
+
+                curl_multi_remove_handle(multi, current.handle);
+
+                // A retried request goes back to waiting, with its id and callback.
+                auto delay = RateLimiter::Clock::duration{};
+                if((result == CURLE_OK) && !current.pageCallback && checkRetry(current.handle, current.uri, current.rateHeaders, current.attempts, current.deadline, delay)){
+                        current.attempts++;
+                        current.active = false;
+                        curl_easy_setopt(current.handle, CURLOPT_WRITEDATA, &current.response);
+                        curl_easy_setopt(current.handle, CURLOPT_HEADERDATA, &current.rateHeaders);
+                        current.response.clear();
+                        current.rateHeaders = RateLimitHeaders{};
+                        current.notBefore = RateLimiter::Clock::now() + delay;
+                        waitingRequests.push_back(id);
+                        continue;
+                }
+
+                const auto request = std::move(it->second);
+                pendingRequests.erase(it);
+
+                // From the first attempt being sent, retries and the wait between them included.
+                if(Tracer::enabled()){
+                        Tracer::record("curl_retrieve_async", request->uri + (request->hedgeWon ? " (hedge won)" : ""), request->started, RateLimiter::Clock::now());
+                }
+
+                if(request->pageCallback){
+                        auto error = std::string{};
+                        long status;
+                        curl_easy_getinfo(request->handle, CURLINFO_RESPONSE_CODE, &status);
+                        if(result != CURLE_OK){
+                                error = "Failed to download "s + request->uri + ": " + curl_easy_strerror(result);
+                        }
+                        else if(status >= 400){
+                                error = "Failed to download " + request->uri + " (HTTP " + std::to_string(status) + ")";
+                        }
+
+                        curl_easy_cleanup(request->handle);
+                        request->pageCallback(std::move(request->response), error);
+                        completed++;
+                        continue;
+                }
+
+                const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(RateLimiter::Clock::now() - request->started);
+                networkStats.recordResponse(NetworkStats::endpointOf(request->uri), latency.count(), request->hedged, request->hedgeWon);
+
+                Json::Value root;
+                std::string error;
+                long status;
+                curl_easy_getinfo(request->handle, CURLINFO_RESPONSE_CODE, &status);
+                if(result != CURLE_OK){
+                        error = "curl_easy_perform() failed: "s + curl_easy_strerror(result);
+                }
+                else if(request->revalidateCallback && (status == 304)){
+                        recordTiming(request->handle, request->uri, 0);
+                }
+                else{
+                        try{
+                                std::istringstream data(request->response);
+                                root = parseResponse(request->handle, request->uri, request->isPost, data);
+                        }
+                        catch(const std::exception& e){
+                                error = e.what();
+                        }
+                }
+
+                curl_easy_cleanup(request->handle);
+                curl_slist_free_all(request->headers);
+
+                // The callback may start or cancel other requests.
+                completeRequest(*request, root, error);
+                completed++;
+        }
+
+        return completed + expireRequests();
+}
+// Send a second copy of the GETs that are due for one, as far as the rate limiter allows.
+void FeedlyProvider::startHedges(){
+        const auto now = RateLimiter::Clock::now();
+        for(auto& [id, request] : pendingRequests){
+                if(!request->active || request->hedged || (request->hedgeAt > now)){
+                        continue;
+                }
+
+                if(!limiter.tryAcquire(request->priority, now)){
+                        return;
+                }
+
+                // The copy shares the URL, the headers and the id, but not the buffers.
+                request->hedged = true;
+                request->hedge = curl_easy_duphandle(request->handle);
+                curl_easy_setopt(request->hedge, CURLOPT_WRITEDATA, &request->hedgeResponse);
+                curl_easy_setopt(request->hedge, CURLOPT_HEADERDATA, &request->hedgeHeaders);
+                setTimeout(request->hedge, request->deadline, now);
+                curl_multi_add_handle(multi, request->hedge);
+                Logger::info("Hedging " + request->uri);
+        }
+}
+// Fail the requests that were still waiting to be sent at their deadline.
+size_t FeedlyProvider::expireRequests(){
+        const auto now = RateLimiter::Clock::now();
+        std::vector<std::unique_ptr<PendingRequest>> expired;
+        for(auto it = waitingRequests.begin(); it != waitingRequests.end();){
+                const auto request = pendingRequests.find(*it);
+                if(request->second->deadline > now){
+                        ++it;
+                        continue;
+                }
+
+                expired.push_back(std::move(request->second));
+                pendingRequests.erase(request);
+                it = waitingRequests.erase(it);
+        }
+
+        for(const auto& request : expired){
+                curl_easy_cleanup(request->handle);
+                curl_slist_free_all(request->headers);
+                Logger::warning("Timed out waiting to send " + request->uri);
+                completeRequest(*request, Json::Value(), "Timed out waiting to send " + request->uri);
+        }
+
+        return expired.size();
+}
+Json::Value FeedlyProvider::parseResponse(CURL* handle, const std::string& uri, bool isPost, std::istream& data){
+        if(isPost){
+                // Markers answer with an empty body, so the status is all there is to check.
+                long status;
+                curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+                if((status >= 400) || (data.peek() == std::char_traits<char>::eof())){
+                        recordTiming(handle, uri, 0);
+                }
+
+                if(status >= 400){
+                        throw std::runtime_error("Feedly rejected the request (HTTP " + std::to_string(status) + ")");
+                }
+
+                if(data.peek() == std::char_traits<char>::eof()){
+                        return Json::Value();
+                }
         }
 
         Json::Reader reader;
         Json::Value root;
-        if(!reader.parse(data, root)){
+        const auto parseStart = std::chrono::steady_clock::now();
+        auto parsed = false;
+        {
+                TraceSpan parseSpan{"JSON parse", uri};
+                parsed = reader.parse(data, root);
+        }
+        const auto parseTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - parseStart);
+
+        recordTiming(handle, uri, parseTime.count());
+
+        if(!parsed){
                 throw std::runtime_error("Failed to parse tokens file: "s + reader.getFormattedErrorMessages());
         }
 
@@ -397,20 +1163,21 @@ Json::Value FeedlyProvider::curl_retrieve(const std::string& uri, const Json::Va
 
         return root;
 }
-void FeedlyProvider::openLogStream(){
-        if(!log_stream.is_open()){
-                log_stream.open(logPath, std::ofstream::out | std::ofstream::app);
-
-                time_t current = time(NULL);
-                struct tm localTime{};
-                localtime_r(&current, &localTime);
-
-                auto buffer = std::array<char, 64>{};
-                if(const auto result = strftime(buffer.data(), buffer.size(), "%a, %d %b %Y %T %z", &localTime); result > 0)
-                {
-                        log_stream << "======== " << buffer.data() << std::endl;
-                }
-        }
+void FeedlyProvider::recordTiming(CURL* handle, const std::string& uri, curl_off_t parse){
+        auto timing = RequestTiming{};
+        timing.endpoint = NetworkStats::endpointOf(uri);
+        timing.parse = parse;
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &timing.status);
+        curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &timing.nameLookup);
+        curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &timing.connect);
+        curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &timing.appConnect);
+        curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &timing.startTransfer);
+        curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &timing.total);
+        curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &timing.bytesDown);
+        curl_easy_getinfo(handle, CURLINFO_SIZE_UPLOAD_T, &timing.bytesUp);
+
+        networkStats.record(timing);
+        Logger::trace(NetworkStats::format(timing));
 }
 void FeedlyProvider::echo(bool on = true){
         struct termios settings;
@@ -421,5 +1188,10 @@ void FeedlyProvider::echo(bool on = true){
         tcsetattr( STDIN_FILENO, TCSANOW, &settings );
 }
 void FeedlyProvider::curl_cleanup(){
+        while(!pendingRequests.empty()){
+                cancelRequest(pendingRequests.begin()->first);
+        }
+
+        curl_multi_cleanup(multi);
         curl_global_cleanup();
 }
@@ -1,23 +1,47 @@
 #include <curl/curl.h>
 #include <json/json.h>
+#include <deque>
 #include <filesystem>
 #include <string>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
+#include "Config.h"
+#include "NetworkStats.h"
+#include "RateLimiter.h"
+#include "RelevanceModel.h"
+
 #define DEFAULT_FCOUNT 500
 #define FEEDLY_URI "https://cloud.feedly.com/v3/"
+#define WORKER_THREADS 4
+#define MAX_HOST_CONNECTIONS 4
+#define CONNECT_TIMEOUT_SECONDS 10
+#define LOW_SPEED_LIMIT_BYTES 64
+#define LOW_SPEED_TIME_SECONDS 20
+#define INTERACTIVE_DEADLINE_SECONDS 30
+#define MARKER_DEADLINE_SECONDS 60
+#define BACKGROUND_DEADLINE_SECONDS 120
+#define MIN_HEDGE_SAMPLES 20
+#define MIN_HEDGE_DELAY_MS 50
+#define MAX_IMPORTS_IN_FLIGHT 16
+#define MAX_PAGE_BYTES (4 * 1024 * 1024)
 
 #ifndef _PROVIDER_H_
 #define _PROVIDER_H_
 
 using CurlString = std::unique_ptr<char, decltype(&curl_free)>;
+using RequestId = unsigned long;
+using Categories = std::map<std::string, std::string>;
 
 struct UserData{
-        std::map<std::string, std::string> categories;
+        // Replaced as a whole by getLabels(); readers keep their own snapshot.
+        std::shared_ptr<const Categories> categories;
         std::string id;
         std::string code;
         std::string authToken;
@@ -31,44 +55,172 @@ struct PostData{
         std::string id;
         std::string originURL;
         std::string originTitle;
+        std::vector<std::string> categoryIds;
+        bool unread{true};
+        bool saved{};
+        // Milliseconds since the epoch, as Feedly reports them.
+        long long published{};
+        long long crawled{};
+        int engagement{};
+        std::string feedId;
+        // False for an entry only known by its id until its content is fetched.
+        bool complete{true};
+        // Set by the relevance model when the post is ingested, see RelevanceModel.
+        double score{};
+        std::vector<unsigned int> features;
+};
+
+// Outcome of an OPML import; every feed is counted once.
+struct ImportReport{
+        size_t subscribed{};
+        size_t skipped{};
+        size_t failed{};
 };
 
+// A feed subscribed to and the ids of the categories it is in.
+struct Subscription{
+        std::string id;
+        std::string title;
+        std::vector<std::string> categoryIds;
+};
+
+using Subscriptions = std::vector<Subscription>;
+
+// What markers/counts reports for a stream.
+struct UnreadCount{
+        int count{};
+        // Milliseconds since the epoch of the stream's newest entry.
+        long long updated{};
+};
+
+// Completion handlers of asynchronous requests. They are invoked from
+// processEvents() and receive an empty error string on success.
+using ResponseCallback = std::function<void(const Json::Value& root, const std::string& error)>;
+using PostsCallback = std::function<void(std::vector<PostData>&& posts, const std::string& error)>;
+// continuation is the one of the next page, empty after the last page.
+using StreamPageCallback = std::function<void(std::vector<PostData>&& posts, const std::string& continuation, const std::string& error)>;
+using ErrorCallback = std::function<void(const std::string& error)>;
+using CountsCallback = std::function<void(std::map<std::string, UnreadCount>&& counts, const std::string& error)>;
+using IdsCallback = std::function<void(std::vector<std::string>&& ids, const std::string& error)>;
+using PageCallback = std::function<void(std::string&& body, const std::string& error)>;
+using SubscriptionsCallback = std::function<void(std::shared_ptr<const Subscriptions> subscriptions, const std::string& error)>;
+// A null root means the resource still matches the ETag it was asked with.
+using RevalidateCallback = std::function<void(const Json::Value& root, const std::string& etag, const std::string& error)>;
+using LabelsCallback = std::function<void(std::shared_ptr<const Categories> labels, const std::string& error)>;
+
+// Blocking calls may be used from any thread.
+// Callback-based requests, waitForEvents() and processEvents() belong
+// to the thread running the UI event loop.
 class FeedlyProvider{
         public:
-                FeedlyProvider(const std::filesystem::path& tmpDir);
+                FeedlyProvider();
                 void authenticateUser();
-                void markPostsRead(const std::vector<std::string>& ids);
-                void markPostsSaved(const std::vector<std::string>& ids);
-                void markPostsUnsaved(const std::vector<std::string>& ids);
-                void markCategoriesRead(const std::string& id, const std::string& lastReadEntryId);
-                void markPostsUnread(const std::vector<std::string>& ids);
+                void markPostsRead(const std::vector<std::string>& ids, ErrorCallback onDone = ErrorCallback());
+                void markPostsSaved(const std::vector<std::string>& ids, ErrorCallback onDone = ErrorCallback());
+                void markPostsUnsaved(const std::vector<std::string>& ids, ErrorCallback onDone = ErrorCallback());
+                void markCategoriesRead(const std::string& id, const std::string& lastReadEntryId, ErrorCallback onDone = ErrorCallback());
+                void markPostsUnread(const std::vector<std::string>& ids, ErrorCallback onDone = ErrorCallback());
                 void addSubscription(bool newCategory, const std::string& feed, std::vector<std::string> categories, const std::string& title = "");
-                const std::vector<PostData>& giveStreamPosts(const std::string& category, bool whichRank = 0);
-                const std::map<std::string, std::string>& getLabels();
+                ImportReport importOpml(const std::filesystem::path& path);
+                RequestId requestStreamPosts(const std::string& category, bool whichRank, PostsCallback callback, Priority priority = Priority::INTERACTIVE);
+                RequestId requestStreamPage(const std::string& category, bool whichRank, const std::string& continuation, StreamPageCallback callback, Priority priority = Priority::INTERACTIVE);
+                RequestId requestNewerPosts(const std::string& category, long long newerThan, PostsCallback callback, Priority priority = Priority::INTERACTIVE);
+                RequestId requestStreamIds(const std::string& category, bool whichRank, IdsCallback callback, Priority priority = Priority::INTERACTIVE);
+                RequestId requestEntries(const std::vector<std::string>& ids, PostsCallback callback);
+                RequestId requestUnreadCounts(CountsCallback callback, Priority priority = Priority::INTERACTIVE);
+                RequestId requestLabels(LabelsCallback callback);
+                RequestId requestSubscriptions(SubscriptionsCallback callback, Priority priority = Priority::INTERACTIVE);
+                RequestId requestPage(const std::string& url, PageCallback callback);
+                void cancelRequest(RequestId id);
+                bool hasPendingRequests() const;
+                void waitForEvents(std::vector<curl_waitfd>& fds, int timeoutMs);
+                size_t processEvents();
+                std::shared_ptr<const Categories> getLabels();
+                std::shared_ptr<const Categories> getCachedLabels() const;
+                // The subscriptions kept from the last session, if any.
+                std::shared_ptr<const Subscriptions> getCachedSubscriptions() const;
+                std::string categoryId(const std::string& label) const;
                 const std::string getUserId();
-                PostData& getSinglePostData(int index);
+                std::shared_ptr<const Config> getConfig() const;
+                std::shared_ptr<const Config> reloadConfig();
+                const std::filesystem::path& getConfigPath() const;
+                const NetworkStats& getNetworkStats() const;
+                RelevanceModel& getRelevance();
                 void setVerbose(bool value);
                 void setChangeTokensFlag(bool value);
                 void curl_cleanup();
         private:
-                CURL *curl;
-                CURLcode curl_res;
-                std::ofstream log_stream;
+                // State of a transfer driven by the multi handle. Until the rate
+                // limiter lets it start, its id waits in waitingRequests. Retries
+                // and the hedge, a second copy of a slow GET, share its deadline.
+                struct PendingRequest{
+                        std::string uri;
+                        bool isPost;
+                        CURL *handle;
+                        struct curl_slist *headers;
+                        std::string response;
+                        ResponseCallback callback;
+                        // Set instead of callback for requestPage() and curl_revalidate_async().
+                        PageCallback pageCallback;
+                        RevalidateCallback revalidateCallback;
+                        Priority priority;
+                        RateLimitHeaders rateHeaders;
+                        unsigned int attempts{};
+                        RateLimiter::Clock::time_point notBefore;
+                        RateLimiter::Clock::time_point deadline;
+                        RateLimiter::Clock::time_point started;
+                        bool active{};
+                        CURL *hedge{};
+                        std::string hedgeResponse;
+                        RateLimitHeaders hedgeHeaders;
+                        RateLimiter::Clock::time_point hedgeAt{RateLimiter::Clock::time_point::max()};
+                        bool hedged{};
+                        bool hedgeWon{};
+                };
+                CURLM *multi;
+                std::map<RequestId, std::unique_ptr<PendingRequest>> pendingRequests;
+                std::deque<RequestId> waitingRequests;
+                RateLimiter limiter;
+                RequestId nextRequestId{1};
                 std::string feedly_url;
                 std::string userAuthCode;
-                std::string TOKEN_PATH, COOKIE_PATH, rtrv_count;
-                const std::filesystem::path tempPath;
-                std::filesystem::path logPath;
+                std::string TOKEN_PATH, COOKIE_PATH;
                 std::filesystem::path configPath;
+                std::shared_ptr<const Config> config;
+                std::string configError;
                 UserData user_data;
                 bool verboseFlag{}, changeTokens{};
-                std::vector<PostData> feeds;
+                NetworkStats networkStats;
+                RelevanceModel relevance;
+                std::filesystem::path subscriptionsPath;
+                std::shared_ptr<const Subscriptions> subscriptions;
+                std::string subscriptionsEtag;
                 void getCookies();
-                void enableVerbose();
                 Json::Value curl_retrieve(const std::string& uri, const Json::Value& jsonCont = Json::Value::nullSingleton());
+                RequestId curl_retrieve_async(const std::string& uri, const Json::Value& jsonCont, ResponseCallback callback, Priority priority = Priority::INTERACTIVE);
+                RequestId curl_revalidate_async(const std::string& uri, const std::string& etag, RevalidateCallback callback, Priority priority = Priority::INTERACTIVE);
+                std::unique_ptr<PendingRequest> newRequest(const std::string& uri, const Json::Value& jsonCont, Priority priority);
+                RequestId enqueueRequest(std::unique_ptr<PendingRequest> request);
+                void completeRequest(PendingRequest& request, const Json::Value& root, const std::string& error);
+                void dispatchRequests();
+                void startHedges();
+                size_t expireRequests();
+                bool checkRetry(CURL* handle, const std::string& uri, const RateLimitHeaders& headers, unsigned int attempt,
+                                RateLimiter::Clock::time_point deadline, RateLimiter::Clock::duration& delay);
+                CURL* newHandle(const std::string& url);
+                CURL* createHandle(const std::string& uri, const Json::Value& jsonCont, struct curl_slist*& headers);
+                Json::Value parseResponse(CURL* handle, const std::string& uri, bool isPost, std::istream& data);
+                void postMarkers(const Json::Value& jsonCont, const std::string& failure, ErrorCallback onDone);
+                std::string streamUri(const std::string& category, bool whichRank);
+                Json::Value subscriptionJson(const std::string& feedId, const std::vector<std::string>& categories, const std::string& title) const;
+                std::shared_ptr<Categories> builtinLabels() const;
+                std::shared_ptr<const Categories> storeLabels(const Json::Value& root);
+                void loadSubscriptions();
+                void saveSubscriptions(const Json::Value& root) const;
+                std::vector<PostData> ingestPosts(const Json::Value& items, const std::string& category);
                 void extract_galx_value();
+                void recordTiming(CURL* handle, const std::string& uri, curl_off_t parse);
                 void echo(bool on);
-                void openLogStream();
                 CurlString escapeCurlString(const std::string& s);
 };
 
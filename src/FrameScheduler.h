@@ -0,0 +1,53 @@
+#include <algorithm>
+#include <chrono>
+
+#ifndef _FRAME_SCHEDULER_H_
+#define _FRAME_SCHEDULER_H_
+
+// Parts of the screen whose drawing is deferred to the next frame.
+enum FrameRegion : unsigned int{
+        FRAME_WINDOWS = 1 << 0, // Menus and borders, drawn in place but not yet flushed.
+        FRAME_STATUS = 1 << 1,  // Status and info lines.
+        FRAME_PREVIEW = 1 << 2, // Preview of the selected post.
+        FRAME_OVERLAY = 1 << 3, // Network stats overlay.
+};
+
+// Collects dirty regions and paces frames so the terminal is written at
+// most once per interval, however many updates happen in between.
+class FrameScheduler{
+        public:
+                explicit FrameScheduler(std::chrono::milliseconds interval):
+                        interval{interval}{
+                }
+                void markDirty(unsigned int regions){
+                        dirtyRegions |= regions;
+                }
+                bool isDirty(unsigned int regions) const{
+                        return (dirtyRegions & regions) != 0;
+                }
+                bool frameDue() const{
+                        return (dirtyRegions != 0) && (std::chrono::steady_clock::now() >= lastFrame + interval);
+                }
+                // How long the event loop may sleep before a frame has to be drawn.
+                int timeoutMs(int idleTimeoutMs) const{
+                        if(dirtyRegions == 0){
+                                return idleTimeoutMs;
+                        }
+
+                        const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(lastFrame + interval - std::chrono::steady_clock::now());
+                        return std::clamp(static_cast<int>(wait.count()), 0, idleTimeoutMs);
+                }
+                // Returns the regions to draw and starts a new frame.
+                unsigned int beginFrame(){
+                        const auto regions = dirtyRegions;
+                        dirtyRegions = 0;
+                        lastFrame = std::chrono::steady_clock::now();
+                        return regions;
+                }
+        private:
+                const std::chrono::milliseconds interval;
+                std::chrono::steady_clock::time_point lastFrame{};
+                unsigned int dirtyRegions{};
+};
+
+#endif
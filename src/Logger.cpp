@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <ctime>
+#include <string.h>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Logger.h"
+
+static const char* levelNames[] = {"TRACE", "INFO ", "WARN ", "ERROR"};
+
+static unsigned int currentThreadId(){
+        static std::atomic<unsigned int> nextId{1};
+        thread_local const auto id = nextId++;
+        return id;
+}
+static void writeAll(int fd, const char* data, size_t length){
+        while(length > 0){
+                const auto written = ::write(fd, data, length);
+                if(written <= 0){
+                        return;
+                }
+
+                data += written;
+                length -= written;
+        }
+}
+// snprintf isn't async-signal-safe, so the crash dump formats numbers itself.
+static void appendNumber(char* out, size_t& used, unsigned long long value, int width){
+        char digits[24];
+        auto count = 0;
+        do{
+                digits[count++] = '0' + (value % 10);
+                value /= 10;
+        }while(value > 0);
+
+        for(; count < width; width--){
+                out[used++] = '0';
+        }
+
+        while(count > 0){
+                out[used++] = digits[--count];
+        }
+}
+
+Logger::Ring::Ring(){
+        for(size_t i = 0; i < LOG_SLOTS; i++){
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+}
+void Logger::start(const std::filesystem::path& logPath){
+        snprintf(path, sizeof(path), "%s", logPath.c_str());
+        running = true;
+        writer = std::thread(run);
+}
+void Logger::stop(){
+        if(!running.exchange(false)){
+                return;
+        }
+
+        // A fatal signal may arrive on the writer thread itself.
+        if(writer.get_id() == std::this_thread::get_id()){
+                writer.detach();
+        }
+        else{
+                writer.join();
+        }
+}
+void Logger::write(LogLevel level, std::string_view text){
+        auto position = head.load(std::memory_order_relaxed);
+        Slot* slot;
+        while(true){
+                slot = &ring.slots[position % LOG_SLOTS];
+                const auto sequence = slot->sequence.load(std::memory_order_acquire);
+                const auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+                if(difference == 0){
+                        if(head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                                break;
+                        }
+                }
+                else if(difference < 0){
+                        dropped.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                }
+                else{
+                        position = head.load(std::memory_order_relaxed);
+                }
+        }
+
+        slot->level = level;
+        slot->thread = currentThreadId();
+        slot->time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        slot->length = std::min(text.size(), sizeof(slot->text));
+        memcpy(slot->text, text.data(), slot->length);
+        slot->sequence.store(position + 1, std::memory_order_release);
+}
+void Logger::run(){
+        const auto fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        if(fd < 0){
+                return;
+        }
+
+        const auto now = time(NULL);
+        struct tm localTime{};
+        localtime_r(&now, &localTime);
+
+        auto buffer = std::array<char, 64>{};
+        if(const auto length = strftime(buffer.data(), buffer.size(), "======== %a, %d %b %Y %T %z\n", &localTime); length > 0){
+                writeAll(fd, buffer.data(), length);
+        }
+
+        while(running.load(std::memory_order_relaxed)){
+                drain(fd);
+                std::this_thread::sleep_for(std::chrono::milliseconds(LOG_DRAIN_MS));
+        }
+
+        drain(fd);
+        close(fd);
+}
+// Only the writer thread takes events out of the ring.
+void Logger::drain(int fd){
+        std::string lines;
+        for(;; tail++){
+                auto& slot = ring.slots[tail % LOG_SLOTS];
+                if(slot.sequence.load(std::memory_order_acquire) != tail + 1){
+                        break;
+                }
+
+                const auto seconds = static_cast<time_t>(slot.time / 1000);
+                struct tm localTime{};
+                localtime_r(&seconds, &localTime);
+
+                auto stamp = std::array<char, 64>{};
+                const auto length = strftime(stamp.data(), stamp.size(), "%F %T", &localTime);
+                snprintf(stamp.data() + length, stamp.size() - length, ".%03lld [%u] %s ", slot.time % 1000, slot.thread, levelNames[static_cast<int>(slot.level)]);
+
+                lines += stamp.data();
+                lines.append(slot.text, slot.length);
+                lines += '\n';
+                slot.sequence.store(tail + LOG_SLOTS, std::memory_order_release);
+        }
+
+        if(const auto lost = dropped.exchange(0, std::memory_order_relaxed); lost > 0){
+                lines += "(" + std::to_string(lost) + " events dropped while the log was full)\n";
+        }
+
+        writeAll(fd, lines.data(), lines.size());
+}
+void Logger::dumpCrash(int signum){
+        const auto fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        if(fd < 0){
+                return;
+        }
+
+        char line[LOG_TEXT_BYTES + 64];
+        size_t used = 0;
+        const char header[] = "======== crashed with signal ";
+        memcpy(line, header, sizeof(header) - 1);
+        used = sizeof(header) - 1;
+        appendNumber(line, used, signum, 0);
+        const char last[] = ", last events (epoch ms [thread] level):\n";
+        memcpy(line + used, last, sizeof(last) - 1);
+        used += sizeof(last) - 1;
+        writeAll(fd, line, used);
+
+        // Slots still being written, or already reused for a newer event, are skipped.
+        const auto end = head.load(std::memory_order_acquire);
+        for(auto position = end - std::min<size_t>(end, LOG_CRASH_EVENTS); position < end; position++){
+                const auto& slot = ring.slots[position % LOG_SLOTS];
+                const auto sequence = slot.sequence.load(std::memory_order_acquire);
+                if((sequence != position + 1) && (sequence != position + LOG_SLOTS)){
+                        continue;
+                }
+
+                used = 0;
+                appendNumber(line, used, slot.time, 0);
+                memcpy(line + used, " [", 2);
+                used += 2;
+                appendNumber(line, used, slot.thread, 0);
+                memcpy(line + used, "] ", 2);
+                used += 2;
+                memcpy(line + used, levelNames[static_cast<int>(slot.level)], 5);
+                used += 5;
+                line[used++] = ' ';
+                memcpy(line + used, slot.text, slot.length);
+                used += slot.length;
+                line[used++] = '\n';
+                writeAll(fd, line, used);
+        }
+
+        close(fd);
+}
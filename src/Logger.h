@@ -0,0 +1,60 @@
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string_view>
+#include <thread>
+
+#ifndef _LOGGER_H_
+#define _LOGGER_H_
+
+#define LOG_SLOTS 1024
+#define LOG_TEXT_BYTES 480
+#define LOG_DRAIN_MS 50
+#define LOG_CRASH_EVENTS 64
+
+enum class LogLevel{TRACE, INFO, WARNING, ERROR};
+
+// Appends timestamped events to log.txt. Writers copy their message into a
+// slot of a fixed ring buffer without taking a lock; a background thread
+// drains it to the file. Messages longer than LOG_TEXT_BYTES are cut, and
+// events are dropped and counted while the ring is full.
+class Logger{
+        public:
+                static void start(const std::filesystem::path& logPath);
+                // Write out what is left in the ring; safe to call more than once.
+                static void stop();
+                static void write(LogLevel level, std::string_view text);
+                static void trace(std::string_view text){ write(LogLevel::TRACE, text); }
+                static void info(std::string_view text){ write(LogLevel::INFO, text); }
+                static void warning(std::string_view text){ write(LogLevel::WARNING, text); }
+                static void error(std::string_view text){ write(LogLevel::ERROR, text); }
+                // Append the last LOG_CRASH_EVENTS events to the log, written or not.
+                // Only async-signal-safe calls, for the handlers of fatal signals.
+                static void dumpCrash(int signum);
+        private:
+                // A slot holding position p has sequence p + 1 once written and
+                // p + LOG_SLOTS once drained, which frees it for position p + LOG_SLOTS.
+                struct Slot{
+                        std::atomic<size_t> sequence;
+                        LogLevel level;
+                        unsigned int thread;
+                        long long time;
+                        size_t length;
+                        char text[LOG_TEXT_BYTES];
+                };
+                struct Ring{
+                        Slot slots[LOG_SLOTS];
+                        Ring();
+                };
+                static inline Ring ring;
+                static inline std::atomic<size_t> head{0};
+                static inline std::atomic<size_t> dropped{0};
+                static inline size_t tail{0};
+                static inline std::atomic<bool> running{false};
+                static inline std::thread writer;
+                static inline char path[4096];
+                static void run();
+                static void drain(int fd);
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <queue>
+
+#include "MergedStream.h"
+
+MergedStream::MergedStream(const std::vector<std::string>& categories, bool oldestFirst):
+        oldestFirst{oldestFirst}{
+        for(const auto& category : categories){
+                sources.push_back({category, {}, {}, false});
+        }
+}
+const std::string& MergedStream::category(size_t source) const{
+        return sources.at(source).category;
+}
+const std::string& MergedStream::continuation(size_t source) const{
+        return sources.at(source).continuation;
+}
+void MergedStream::addPage(size_t source, std::vector<PostData>&& posts, const std::string& continuation){
+        auto& stream = sources.at(source);
+        stream.buffer.insert(stream.buffer.end(), std::make_move_iterator(posts.begin()), std::make_move_iterator(posts.end()));
+        stream.continuation = continuation;
+        stream.loaded = true;
+}
+bool MergedStream::loaded() const{
+        return std::all_of(sources.begin(), sources.end(), [](const Source& source){ return source.loaded; });
+}
+// A heap of the sources by their first post makes taking n posts from k
+// sources O(n log k).
+size_t MergedStream::merge(std::vector<PostData>& merged){
+        const auto after = [this](size_t a, size_t b){
+                const auto first = sources[a].buffer.front().published;
+                const auto second = sources[b].buffer.front().published;
+                return oldestFirst ? (first > second) : (first < second);
+        };
+
+        auto heads = std::priority_queue<size_t, std::vector<size_t>, decltype(after)>(after);
+        for(size_t i = 0; i < sources.size(); i++){
+                if(!sources[i].buffer.empty()){
+                        heads.push(i);
+                }
+                else if(sources[i].hasMore()){
+                        return 0;
+                }
+        }
+
+        const auto before = merged.size();
+        while(!heads.empty()){
+                const auto next = heads.top();
+                heads.pop();
+
+                auto& source = sources[next];
+                if(listed.insert(source.buffer.front().id).second){
+                        merged.push_back(std::move(source.buffer.front()));
+                }
+
+                source.buffer.pop_front();
+                if(!source.buffer.empty()){
+                        heads.push(next);
+                }
+                else if(source.hasMore()){
+                        break;
+                }
+        }
+
+        return merged.size() - before;
+}
+std::vector<size_t> MergedStream::starved() const{
+        auto starved = std::vector<size_t>{};
+        for(size_t i = 0; i < sources.size(); i++){
+                if(sources[i].loaded && sources[i].buffer.empty() && sources[i].hasMore()){
+                        starved.push_back(i);
+                }
+        }
+
+        return starved;
+}
@@ -0,0 +1,49 @@
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#ifndef _MERGED_STREAM_H_
+#define _MERGED_STREAM_H_
+
+#include "FeedlyProvider.h"
+
+// Several category streams listed as one, ordered by published time. The
+// pages of every source are already in that order, so they are merged by
+// always taking the first post of the source that comes first, and an
+// entry in several of the categories is listed once. Posts are only
+// taken while every source with more pages still has posts buffered, as
+// a page not fetched yet may hold a post that comes before them.
+class MergedStream{
+        public:
+                MergedStream(const std::vector<std::string>& categories, bool oldestFirst);
+                size_t size() const{
+                        return sources.size();
+                }
+                const std::string& category(size_t source) const;
+                // Empty for the first page of a source.
+                const std::string& continuation(size_t source) const;
+                // continuation is the one of the next page, empty after the last page.
+                void addPage(size_t source, std::vector<PostData>&& posts, const std::string& continuation);
+                // Whether the first page of every source has arrived.
+                bool loaded() const;
+                // Append the posts that can be placed to merged.
+                size_t merge(std::vector<PostData>& merged);
+                // Sources holding up the merge until their next page is fetched.
+                std::vector<size_t> starved() const;
+        private:
+                struct Source{
+                        std::string category;
+                        std::deque<PostData> buffer;
+                        std::string continuation;
+                        bool loaded{};
+                        bool hasMore() const{
+                                return !loaded || !continuation.empty();
+                        }
+                };
+                std::vector<Source> sources;
+                bool oldestFirst;
+                std::unordered_set<std::string> listed;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <sstream>
+
+#include "NetworkStats.h"
+
+static curl_off_t percentile(std::vector<curl_off_t> values, unsigned int percent){
+        if(values.empty()){
+                return 0;
+        }
+
+        const auto rank = (values.size() - 1) * percent / 100;
+        std::nth_element(values.begin(), values.begin() + rank, values.end());
+        return values[rank];
+}
+
+// Reduce a request URI to a stable key, e.g. "streams/*/contents" for any stream.
+std::string NetworkStats::endpointOf(const std::string& uri){
+        const auto path = uri.substr(0, uri.find('?'));
+
+        std::string endpoint;
+        std::istringstream segments(path);
+        for(std::string segment; std::getline(segments, segment, '/');){
+                if(!endpoint.empty()){
+                        endpoint += '/';
+                }
+
+                // Escaped stream and entry ids contain "%2F" or ':'.
+                if((segment.find('%') != std::string::npos) || (segment.find(':') != std::string::npos)){
+                        endpoint += '*';
+                }
+                else{
+                        endpoint += segment;
+                }
+        }
+
+        return endpoint;
+}
+std::string NetworkStats::format(const RequestTiming& timing){
+        std::ostringstream line;
+        line << "net endpoint=" << timing.endpoint
+             << " status=" << timing.status
+             << " namelookup_us=" << timing.nameLookup
+             << " connect_us=" << timing.connect
+             << " appconnect_us=" << timing.appConnect
+             << " starttransfer_us=" << timing.startTransfer
+             << " total_us=" << timing.total
+             << " parse_us=" << timing.parse
+             << " bytes_down=" << timing.bytesDown
+             << " bytes_up=" << timing.bytesUp;
+        return line.str();
+}
+void NetworkStats::record(const RequestTiming& timing){
+        std::lock_guard lock(mutex);
+        auto& window = windows[timing.endpoint];
+        window.samples[window.next] = timing;
+        window.next = (window.next + 1) % window.samples.size();
+        window.count = std::min(window.count + 1, window.samples.size());
+        window.requests++;
+        window.bytesDown += timing.bytesDown;
+}
+void NetworkStats::recordResponse(const std::string& endpoint, curl_off_t latency, bool hedged, bool hedgeWon){
+        std::lock_guard lock(mutex);
+        auto& window = windows[endpoint];
+        window.responses[window.nextResponse] = latency;
+        window.nextResponse = (window.nextResponse + 1) % window.responses.size();
+        window.responseCount = std::min(window.responseCount + 1, window.responses.size());
+        window.hedged += hedged;
+        window.hedgesWon += hedgeWon;
+}
+curl_off_t NetworkStats::totalPercentile(const std::string& endpoint, unsigned int percent, size_t minSamples) const{
+        std::lock_guard lock(mutex);
+        const auto it = windows.find(endpoint);
+        if((it == windows.end()) || (it->second.count < std::max<size_t>(minSamples, 1))){
+                return -1;
+        }
+
+        std::vector<curl_off_t> total;
+        for(size_t i = 0; i < it->second.count; i++){
+                total.push_back(it->second.samples[i].total);
+        }
+
+        return percentile(total, percent);
+}
+std::vector<EndpointSummary> NetworkStats::summarize() const{
+        std::lock_guard lock(mutex);
+        std::vector<EndpointSummary> summaries;
+        for(const auto& [endpoint, window] : windows){
+                std::vector<curl_off_t> dns, tcp, tls, ttfb, total, parse;
+                for(size_t i = 0; i < window.count; i++){
+                        const auto& sample = window.samples[i];
+
+                        // curl reports cumulative times; split them into phases.
+                        // appconnect stays zero for plain HTTP and reused connections.
+                        dns.push_back(sample.nameLookup);
+                        tcp.push_back(std::max<curl_off_t>(sample.connect - sample.nameLookup, 0));
+                        tls.push_back(std::max<curl_off_t>(sample.appConnect - sample.connect, 0));
+                        ttfb.push_back(sample.startTransfer);
+                        total.push_back(sample.total);
+                        parse.push_back(sample.parse);
+                }
+
+                auto summary = EndpointSummary{};
+                summary.endpoint = endpoint;
+                summary.requests = window.requests;
+                summary.dnsMedian = percentile(dns, 50);
+                summary.tcpMedian = percentile(tcp, 50);
+                summary.tlsMedian = percentile(tls, 50);
+                summary.ttfbMedian = percentile(ttfb, 50);
+                summary.totalP50 = percentile(total, 50);
+                summary.totalP90 = percentile(total, 90);
+                summary.totalP99 = percentile(total, 99);
+                summary.parseMedian = percentile(parse, 50);
+                summary.bytesDown = window.bytesDown;
+                summary.responseP99 = percentile(std::vector<curl_off_t>(window.responses.begin(), window.responses.begin() + window.responseCount), 99);
+                summary.hedged = window.hedged;
+                summary.hedgesWon = window.hedgesWon;
+                summaries.push_back(summary);
+        }
+
+        return summaries;
+}
@@ -0,0 +1,75 @@
+#include <curl/curl.h>
+#include <array>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef _NETWORK_STATS_H_
+#define _NETWORK_STATS_H_
+
+#define STATS_WINDOW_SIZE 256
+
+// Timings of a single API call. All durations are in microseconds and,
+// except for parse, are measured from the start of the transfer as curl does.
+struct RequestTiming{
+        std::string endpoint;
+        long status{};
+        curl_off_t nameLookup{};
+        curl_off_t connect{};
+        curl_off_t appConnect{};
+        curl_off_t startTransfer{};
+        curl_off_t total{};
+        curl_off_t bytesDown{};
+        curl_off_t bytesUp{};
+        curl_off_t parse{};
+};
+
+struct EndpointSummary{
+        std::string endpoint;
+        unsigned long requests{};
+        curl_off_t dnsMedian{};
+        curl_off_t tcpMedian{};
+        curl_off_t tlsMedian{};
+        curl_off_t ttfbMedian{};
+        curl_off_t totalP50{};
+        curl_off_t totalP90{};
+        curl_off_t totalP99{};
+        curl_off_t parseMedian{};
+        curl_off_t bytesDown{};
+        // Time until the answer, which hedging shortens compared to totalP99.
+        curl_off_t responseP99{};
+        unsigned long hedged{};
+        unsigned long hedgesWon{};
+};
+
+class NetworkStats{
+        public:
+                static std::string endpointOf(const std::string& uri);
+                static std::string format(const RequestTiming& timing);
+                void record(const RequestTiming& timing);
+                // The time from a request's first attempt to its answer.
+                void recordResponse(const std::string& endpoint, curl_off_t latency, bool hedged, bool hedgeWon);
+                // A percentile of the endpoint's transfer times, -1 with fewer than minSamples.
+                curl_off_t totalPercentile(const std::string& endpoint, unsigned int percent, size_t minSamples) const;
+                std::vector<EndpointSummary> summarize() const;
+        private:
+                // The last STATS_WINDOW_SIZE samples of an endpoint.
+                struct Window{
+                        std::array<RequestTiming, STATS_WINDOW_SIZE> samples{};
+                        size_t next{};
+                        size_t count{};
+                        unsigned long requests{};
+                        curl_off_t bytesDown{};
+                        std::array<curl_off_t, STATS_WINDOW_SIZE> responses{};
+                        size_t nextResponse{};
+                        size_t responseCount{};
+                        unsigned long hedged{};
+                        unsigned long hedgesWon{};
+                };
+                mutable std::mutex mutex;
+                std::map<std::string, Window> windows;
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "OpmlReader.h"
+
+static std::string lowercase(std::string text){
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c){ return std::tolower(c); });
+        return text;
+}
+static void appendUtf8(std::string& text, unsigned long codePoint){
+        if(codePoint < 0x80){
+                text += static_cast<char>(codePoint);
+        }
+        else if(codePoint < 0x800){
+                text += static_cast<char>(0xC0 | (codePoint >> 6));
+                text += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        else if(codePoint < 0x10000){
+                text += static_cast<char>(0xE0 | (codePoint >> 12));
+                text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                text += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        else{
+                text += static_cast<char>(0xF0 | (codePoint >> 18));
+                text += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+                text += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                text += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+}
+
+OpmlReader::OpmlReader(std::istream& in):
+        in{in}{
+}
+bool OpmlReader::next(OpmlFeed& feed){
+        for(auto tag = Tag{}; readTag(tag);){
+                if(tag.name != "outline"){
+                        continue;
+                }
+
+                if(tag.closing){
+                        if(!outlines.empty()){
+                                if(outlines.back()){
+                                        folders.pop_back();
+                                }
+
+                                outlines.pop_back();
+                        }
+
+                        continue;
+                }
+
+                const auto attribute = [&tag](const std::string& name){
+                        const auto it = tag.attributes.find(name);
+                        return (it != tag.attributes.end()) ? it->second : std::string{};
+                };
+
+                const auto title = !attribute("title").empty() ? attribute("title") : attribute("text");
+                const auto url = attribute("xmlurl");
+                if(url.empty()){
+                        if(!tag.selfClosing){
+                                outlines.push_back(true);
+                                folders.push_back(title);
+                        }
+
+                        continue;
+                }
+
+                if(!tag.selfClosing){
+                        outlines.push_back(false);
+                }
+
+                feed = OpmlFeed{url, title, {}};
+                if(!folders.empty()){
+                        feed.categories.push_back(folders.back());
+                }
+                else{
+                        // OPML 2.0 lists categories as comma-separated paths like "/Tech/News".
+                        std::istringstream paths(attribute("category"));
+                        for(std::string path; std::getline(paths, path, ',');){
+                                const auto label = path.substr(path.find_last_of('/') + 1);
+                                if(!label.empty()){
+                                        feed.categories.push_back(label);
+                                }
+                        }
+                }
+
+                return true;
+        }
+
+        return false;
+}
+bool OpmlReader::readTag(Tag& tag){
+        while(true){
+                // The text between tags carries nothing OPML needs.
+                in.ignore(std::numeric_limits<std::streamsize>::max(), '<');
+                if(in.eof()){
+                        return false;
+                }
+
+                if(in.peek() == '?'){
+                        skipPast("?>");
+                        continue;
+                }
+
+                if(in.peek() == '!'){
+                        in.get();
+                        if(in.peek() == '-'){
+                                skipPast("-->");
+                        }
+                        else{
+                                skipPast(">");
+                        }
+
+                        continue;
+                }
+
+                // A '>' may appear inside a quoted attribute value.
+                std::string raw;
+                auto quote = '\0';
+                char c;
+                while(in.get(c)){
+                        if(quote != '\0'){
+                                if(c == quote){
+                                        quote = '\0';
+                                }
+                        }
+                        else if((c == '"') || (c == '\'')){
+                                quote = c;
+                        }
+                        else if(c == '>'){
+                                break;
+                        }
+
+                        raw += c;
+                }
+
+                if(!in){
+                        throw std::runtime_error("Unterminated tag in the OPML file");
+                }
+
+                tag = Tag{};
+                tag.closing = !raw.empty() && (raw.front() == '/');
+                tag.selfClosing = !raw.empty() && (raw.back() == '/');
+
+                std::istringstream parts(raw.substr(tag.closing ? 1 : 0, raw.size() - (tag.closing ? 1 : 0) - (tag.selfClosing ? 1 : 0)));
+                parts >> tag.name;
+                tag.name = lowercase(tag.name);
+
+                // Attributes are name="value" pairs; names are matched case-insensitively.
+                while(parts >> std::ws, std::getline(parts, raw, '=')){
+                        const auto name = lowercase(raw.substr(0, raw.find_last_not_of(" \t\r\n") + 1));
+                        parts >> std::ws;
+                        const auto delimiter = static_cast<char>(parts.get());
+                        if((delimiter != '"') && (delimiter != '\'')){
+                                throw std::runtime_error("Unquoted attribute " + name + " in the OPML file");
+                        }
+
+                        std::string value;
+                        std::getline(parts, value, delimiter);
+                        tag.attributes[name] = decode(value);
+                }
+
+                return true;
+        }
+}
+void OpmlReader::skipPast(const std::string& terminator){
+        std::string window;
+        char c;
+        while(in.get(c)){
+                window += c;
+                if(window.size() > terminator.size()){
+                        window.erase(0, 1);
+                }
+
+                if(window == terminator){
+                        return;
+                }
+        }
+
+        throw std::runtime_error("Unterminated markup in the OPML file");
+}
+// Replace the predefined entities and character references.
+std::string OpmlReader::decode(const std::string& text){
+        static const std::map<std::string, char> entities{
+                {"amp", '&'}, {"lt", '<'}, {"gt", '>'}, {"quot", '"'}, {"apos", '\''}};
+
+        std::string decoded;
+        for(size_t i = 0; i < text.size(); i++){
+                const auto end = text.find(';', i);
+                if((text[i] != '&') || (end == std::string::npos)){
+                        decoded += text[i];
+                        continue;
+                }
+
+                const auto name = text.substr(i + 1, end - i - 1);
+                if(const auto entity = entities.find(name); entity != entities.end()){
+                        decoded += entity->second;
+                }
+                else if((name.size() > 1) && (name[0] == '#')){
+                        try{
+                                const auto hex = (name[1] == 'x') || (name[1] == 'X');
+                                appendUtf8(decoded, std::stoul(name.substr(hex ? 2 : 1), NULL, hex ? 16 : 10));
+                        }
+                        catch(const std::exception&){
+                                decoded += text.substr(i, end - i + 1);
+                        }
+                }
+                else{
+                        decoded += text.substr(i, end - i + 1);
+                }
+
+                i = end;
+        }
+
+        return decoded;
+}
@@ -0,0 +1,40 @@
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef _OPML_READER_H_
+#define _OPML_READER_H_
+
+// A feed outline. categories holds the title of the enclosing folder
+// outline, or the last segments of its "category" attribute.
+struct OpmlFeed{
+        std::string url;
+        std::string title;
+        std::vector<std::string> categories;
+};
+
+// Pulls the feeds out of an OPML document one at a time, reading tag by
+// tag so the document is never held in memory as a whole.
+class OpmlReader{
+        public:
+                explicit OpmlReader(std::istream& in);
+                // False at the end of the document; throws on broken markup.
+                bool next(OpmlFeed& feed);
+        private:
+                struct Tag{
+                        std::string name;
+                        std::map<std::string, std::string> attributes;
+                        bool closing{};
+                        bool selfClosing{};
+                };
+                std::istream& in;
+                // Whether each open outline is a folder, and the titles of the folders.
+                std::vector<bool> outlines;
+                std::vector<std::string> folders;
+                bool readTag(Tag& tag);
+                void skipPast(const std::string& terminator);
+                static std::string decode(const std::string& text);
+};
+
+#endif
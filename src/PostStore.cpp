@@ -0,0 +1,83 @@
+#include "PostStore.h"
+
+const PostState& PostStore::state(const std::string& id) const{
+        static const auto unknown = PostState{};
+        const auto it = states.find(id);
+        return (it != states.end()) ? it->second : unknown;
+}
+void PostStore::observe(const std::vector<PostData>& posts){
+        for(const auto& post : posts){
+                if(pending.count(post.id) > 0){
+                        continue;
+                }
+
+                auto& state = states[post.id];
+                state.read = !post.unread;
+                state.saved = post.saved;
+                state.visible = post.unread;
+        }
+}
+ChangeId PostStore::markRead(const std::vector<std::string>& ids, bool read){
+        return apply(ids, Field::READ, read);
+}
+ChangeId PostStore::markSaved(const std::vector<std::string>& ids, bool saved){
+        return apply(ids, Field::SAVED, saved);
+}
+ChangeId PostStore::apply(const std::vector<std::string>& ids, Field field, bool value){
+        auto change = Change{field, {}};
+        for(const auto& id : ids){
+                auto& state = states[id];
+                change.previous.emplace_back(id, state);
+                pending[id]++;
+
+                if(field == Field::READ){
+                        state.read = value;
+                        state.visible = !value;
+                }
+                else{
+                        state.saved = value;
+                }
+        }
+
+        const auto id = nextChange++;
+        changes.emplace(id, std::move(change));
+        return id;
+}
+void PostStore::confirm(ChangeId change){
+        const auto it = changes.find(change);
+        if(it == changes.end()){
+                return;
+        }
+
+        settle(it->second);
+        changes.erase(it);
+}
+// Restore only the field the change touched, so a later change of
+// another field of the same entry survives.
+void PostStore::rollback(ChangeId change){
+        const auto it = changes.find(change);
+        if(it == changes.end()){
+                return;
+        }
+
+        for(const auto& [id, previous] : it->second.previous){
+                auto& state = states[id];
+                if(it->second.field == Field::READ){
+                        state.read = previous.read;
+                        state.visible = previous.visible;
+                }
+                else{
+                        state.saved = previous.saved;
+                }
+        }
+
+        settle(it->second);
+        changes.erase(it);
+}
+void PostStore::settle(const Change& change){
+        for(const auto& [id, previous] : change.previous){
+                if(const auto count = pending.find(id); (count != pending.end()) && (--count->second == 0)){
+                        pending.erase(count);
+                }
+        }
+}
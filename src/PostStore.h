@@ -0,0 +1,46 @@
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef _POST_STORE_H_
+#define _POST_STORE_H_
+
+#include "FeedlyProvider.h"
+
+struct PostState{
+        bool read{};
+        bool saved{};
+        // Whether the entry is listed the next time a post list is built.
+        bool visible{true};
+};
+
+using ChangeId = unsigned long;
+
+// Local state of every entry seen in a stream. Actions change it at once
+// and are later confirmed, or rolled back if the server rejects them.
+class PostStore{
+        public:
+                const PostState& state(const std::string& id) const;
+                // Take over the state reported by the server, except for
+                // entries whose local changes haven't been confirmed yet.
+                void observe(const std::vector<PostData>& posts);
+                // A read entry is also hidden from lists built later.
+                ChangeId markRead(const std::vector<std::string>& ids, bool read);
+                ChangeId markSaved(const std::vector<std::string>& ids, bool saved);
+                void confirm(ChangeId change);
+                void rollback(ChangeId change);
+        private:
+                enum class Field{READ, SAVED};
+                struct Change{
+                        Field field;
+                        std::vector<std::pair<std::string, PostState>> previous;
+                };
+                std::map<std::string, PostState> states;
+                std::map<std::string, unsigned int> pending;
+                std::map<ChangeId, Change> changes;
+                ChangeId nextChange{1};
+                ChangeId apply(const std::vector<std::string>& ids, Field field, bool value);
+                void settle(const Change& change);
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#include "RateLimiter.h"
+
+void RateLimitHeaders::parse(const char* line, size_t length){
+        const auto header = std::string(line, length);
+        const auto colon = header.find(':');
+        if(colon == std::string::npos){
+                return;
+        }
+
+        auto name = header.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c){ return std::tolower(c); });
+
+        if(name == "etag"){
+                const auto value = header.substr(colon + 1);
+                const auto first = value.find_first_not_of(" \t");
+                const auto last = value.find_last_not_of(" \t\r\n");
+                etag = (first != std::string::npos) ? value.substr(first, last - first + 1) : std::string{};
+                return;
+        }
+
+        long* field = NULL;
+        if(name == "x-ratelimit-limit"){
+                field = &limit;
+        }
+        else if(name == "x-ratelimit-count"){
+                field = &count;
+        }
+        else if(name == "x-ratelimit-reset"){
+                field = &reset;
+        }
+        else if(name == "retry-after"){
+                field = &retryAfter;
+        }
+
+        // Retry-After may also be a date, which is left to the backoff.
+        try{
+                if(field != NULL){
+                        *field = std::stol(header.substr(colon + 1));
+                }
+        }
+        catch(const std::exception&){
+        }
+}
+
+RateLimiter::RateLimiter():
+        lastRefill{Clock::now()}{
+}
+bool RateLimiter::tryAcquire(Priority priority, Clock::time_point now){
+        std::lock_guard lock(mutex);
+        refill(now);
+        if((now < pausedUntil) || !quotaAllows(priority) || (tokens < threshold(priority))){
+                return false;
+        }
+
+        tokens -= 1;
+        if(quotaRemaining > 0){
+                quotaRemaining--;
+        }
+
+        return true;
+}
+RateLimiter::Clock::time_point RateLimiter::nextSlot(Priority priority, Clock::time_point now){
+        std::lock_guard lock(mutex);
+        refill(now);
+        if(now < pausedUntil){
+                return pausedUntil;
+        }
+
+        if(!quotaAllows(priority)){
+                return quotaReset;
+        }
+
+        if(tokens >= threshold(priority)){
+                return now;
+        }
+
+        const auto wait = std::chrono::duration<double>((threshold(priority) - tokens) / REQUEST_RATE);
+        return now + std::chrono::duration_cast<Clock::duration>(wait);
+}
+// Responses may arrive out of order, so the latest one wins; the
+// local count keeps going down between them.
+void RateLimiter::update(const RateLimitHeaders& headers, Clock::time_point now){
+        if((headers.limit <= 0) || (headers.count < 0)){
+                return;
+        }
+
+        std::lock_guard lock(mutex);
+        quotaLimit = headers.limit;
+        quotaRemaining = std::max(headers.limit - headers.count, 0L);
+        quotaReset = now + std::chrono::seconds((headers.reset >= 0) ? headers.reset : 60);
+}
+// Exponential backoff with jitter, so retries of requests that failed
+// together don't hit the server together again.
+RateLimiter::Clock::duration RateLimiter::retryDelay(unsigned int attempt, long status, const RateLimitHeaders& headers, Clock::time_point now){
+        std::lock_guard lock(mutex);
+        const auto base = std::min<long>(RETRY_MAX_MS, RETRY_BASE_MS * (1L << std::min(attempt, 16U)));
+        auto delay = Clock::duration(std::chrono::milliseconds(std::uniform_int_distribution<long>(base / 2, base)(random)));
+        if(headers.retryAfter > 0){
+                delay = std::max<Clock::duration>(delay, std::chrono::seconds(headers.retryAfter));
+        }
+
+        if(status == 429){
+                pausedUntil = std::max(pausedUntil, now + delay);
+        }
+
+        return delay;
+}
+void RateLimiter::refill(Clock::time_point now){
+        if((quotaRemaining >= 0) && (now >= quotaReset)){
+                quotaRemaining = -1;
+        }
+
+        if(now > lastRefill){
+                tokens = std::min<double>(REQUEST_BURST, tokens + std::chrono::duration<double>(now - lastRefill).count() * REQUEST_RATE);
+                lastRefill = now;
+        }
+}
+double RateLimiter::threshold(Priority priority) const{
+        return (priority == Priority::INTERACTIVE) ? 1 : (1 + BACKGROUND_RESERVE);
+}
+bool RateLimiter::quotaAllows(Priority priority) const{
+        if(quotaRemaining < 0){
+                return true;
+        }
+
+        if(priority == Priority::INTERACTIVE){
+                return quotaRemaining > 0;
+        }
+
+        return quotaRemaining > quotaLimit * BACKGROUND_QUOTA_PERCENT / 100;
+}
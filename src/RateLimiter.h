@@ -0,0 +1,62 @@
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+
+#ifndef _RATE_LIMITER_H_
+#define _RATE_LIMITER_H_
+
+#define REQUEST_RATE 10
+#define REQUEST_BURST 8
+#define BACKGROUND_RESERVE 2
+#define BACKGROUND_QUOTA_PERCENT 10
+#define MAX_RETRIES 3
+#define RETRY_BASE_MS 500
+#define RETRY_MAX_MS 30000
+
+// Background requests only run when they can't delay an interactive one.
+enum class Priority{INTERACTIVE, BACKGROUND};
+
+// The quota Feedly reports with each response; -1 where a header is missing.
+// The ETag comes along as it is read from the same headers.
+struct RateLimitHeaders{
+        long limit{-1};
+        long count{-1};
+        long reset{-1};
+        long retryAfter{-1};
+        std::string etag;
+        // Take over a header line if it is one of the above.
+        void parse(const char* line, size_t length);
+};
+
+// A token bucket refilled at REQUEST_RATE per second that also keeps to the
+// quota announced by the server. Background requests leave BACKGROUND_RESERVE
+// tokens and the last BACKGROUND_QUOTA_PERCENT of the quota to interactive ones.
+// Safe to use from several threads.
+class RateLimiter{
+        public:
+                using Clock = std::chrono::steady_clock;
+                RateLimiter();
+                // Take a token if a request of the given priority may start now.
+                bool tryAcquire(Priority priority, Clock::time_point now);
+                // The earliest time tryAcquire() may succeed.
+                Clock::time_point nextSlot(Priority priority, Clock::time_point now);
+                void update(const RateLimitHeaders& headers, Clock::time_point now);
+                // How long to wait before retrying a request that failed with the
+                // given status. A 429 also holds back every other request.
+                Clock::duration retryDelay(unsigned int attempt, long status, const RateLimitHeaders& headers, Clock::time_point now);
+        private:
+                std::mutex mutex;
+                double tokens{REQUEST_BURST};
+                long quotaLimit{-1};
+                long quotaRemaining{-1};
+                Clock::time_point lastRefill;
+                Clock::time_point pausedUntil;
+                Clock::time_point quotaReset;
+                std::minstd_rand random{std::random_device{}()};
+                void refill(Clock::time_point now);
+                double threshold(Priority priority) const;
+                bool quotaAllows(Priority priority) const;
+};
+
+#endif
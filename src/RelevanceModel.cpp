@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+#include <json/json.h>
+
+#include "FeedlyProvider.h"
+#include "RelevanceModel.h"
+
+namespace fs = std::filesystem;
+
+// How strongly each reaction says the post was wanted: the target of the
+// step and its size relative to RELEVANCE_LEARNING_RATE.
+static std::pair<double, double> targetOf(Reaction reaction){
+        switch(reaction){
+                case Reaction::OPENED:
+                        return {1, 1};
+                case Reaction::SAVED:
+                        return {1, 2};
+                case Reaction::READ:
+                        return {1, 0.5};
+                case Reaction::SKIPPED:
+                        break;
+        }
+
+        return {0, 1};
+}
+
+RelevanceModel::RelevanceModel(const fs::path& path):
+        path{path}{
+}
+void RelevanceModel::load(){
+        auto input = std::ifstream(path);
+        if(!input){
+                return;
+        }
+
+        Json::CharReaderBuilder builder;
+        Json::Value root;
+        std::string errors;
+        if(!Json::parseFromStream(builder, input, &root, &errors)){
+                throw std::runtime_error("Failed to parse " + path.native() + ": " + errors);
+        }
+
+        std::lock_guard lock(mutex);
+        bias = root["bias"].asDouble();
+        for(const auto group : {"feeds", "terms"}){
+                for(const auto& name : root[group].getMemberNames()){
+                        weights[intern(name)] = root[group][name].asDouble();
+                }
+        }
+}
+// Weights that never moved far from zero are left out; they score the same.
+void RelevanceModel::save() const{
+        Json::Value root;
+        {
+                std::lock_guard lock(mutex);
+                root["bias"] = bias;
+                root["feeds"] = Json::Value(Json::objectValue);
+                root["terms"] = Json::Value(Json::objectValue);
+                for(size_t id = 0; id < weights.size(); id++){
+                        if(std::abs(weights[id]) >= RELEVANCE_MIN_WEIGHT){
+                                const auto& name = featureNames[id];
+                                root[(name.find('/') != std::string::npos) ? "feeds" : "terms"][name] = weights[id];
+                        }
+                }
+        }
+
+        fs::create_directories(path.parent_path());
+        auto partial = path;
+        partial += ".part";
+
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        if(auto output = std::ofstream(partial); !(output << Json::writeString(builder, root))){
+                throw std::runtime_error("Failed to write " + partial.native());
+        }
+
+        fs::rename(partial, path);
+}
+void RelevanceModel::score(std::vector<PostData>& posts){
+        // Titles are split before taking the lock; other threads may be scoring too.
+        auto words = std::vector<std::vector<std::string>>(posts.size());
+        for(size_t i = 0; i < posts.size(); i++){
+                if(posts[i].features.empty()){
+                        words[i] = termsOf(posts[i].title);
+                }
+        }
+
+        std::lock_guard lock(mutex);
+        for(size_t i = 0; i < posts.size(); i++){
+                auto& post = posts[i];
+                if(post.features.empty()){
+                        post.features = featuresOf(post, words[i]);
+                }
+
+                post.score = scoreLocked(post, post.features);
+        }
+}
+void RelevanceModel::learn(const PostData& post, Reaction reaction){
+        const auto [target, strength] = targetOf(reaction);
+        const auto words = post.features.empty() ? termsOf(post.title) : std::vector<std::string>{};
+
+        std::lock_guard lock(mutex);
+        const auto features = post.features.empty() ? featuresOf(post, words) : post.features;
+        const auto predicted = 1 / (1 + std::exp(-scoreLocked(post, features)));
+        const auto step = RELEVANCE_LEARNING_RATE * strength * (target - predicted);
+
+        bias += step;
+        const auto wordCount = features.size() - (post.feedId.empty() ? 0 : 1);
+        for(size_t i = 0; i < features.size(); i++){
+                weights[features[i]] += ((i == 0) && !post.feedId.empty()) ? step : step / std::sqrt(wordCount);
+        }
+}
+unsigned int RelevanceModel::intern(const std::string& name){
+        const auto [it, added] = featureIds.try_emplace(name, weights.size());
+        if(added){
+                featureNames.push_back(name);
+                weights.push_back(0);
+        }
+
+        return it->second;
+}
+// The feed comes first, if the post has one.
+std::vector<unsigned int> RelevanceModel::featuresOf(const PostData& post, const std::vector<std::string>& words){
+        auto features = std::vector<unsigned int>{};
+        features.reserve(words.size() + 1);
+        if(!post.feedId.empty()){
+                features.push_back(intern(post.feedId));
+        }
+
+        for(const auto& word : words){
+                features.push_back(intern(word));
+        }
+
+        return features;
+}
+// The words share one feed's worth of weight, so long titles don't score higher.
+double RelevanceModel::scoreLocked(const PostData& post, const std::vector<unsigned int>& features) const{
+        auto total = bias;
+        const auto hasFeed = !post.feedId.empty();
+        const auto wordCount = features.size() - (hasFeed ? 1 : 0);
+        for(size_t i = 0; i < features.size(); i++){
+                total += ((i == 0) && hasFeed) ? weights[features[i]] : weights[features[i]] / std::sqrt(wordCount);
+        }
+
+        return total;
+}
+// Lowercased words of three or more letters, without the most common ones.
+// Bytes outside ASCII are kept as letters so other scripts get words too.
+std::vector<std::string> RelevanceModel::termsOf(const std::string& title){
+        static const std::set<std::string> common{
+                "and", "are", "but", "for", "from", "has", "have", "how", "its", "new", "not",
+                "now", "the", "this", "that", "was", "what", "when", "why", "will", "with", "you", "your"};
+
+        auto words = std::vector<std::string>{};
+        auto word = std::string{};
+        const auto finish = [&words, &word]{
+                if((word.size() >= 3) && (common.count(word) == 0) && (std::find(words.begin(), words.end(), word) == words.end())){
+                        words.push_back(word);
+                }
+
+                word.clear();
+        };
+
+        for(const auto c : title){
+                const auto byte = static_cast<unsigned char>(c);
+                if(std::isalnum(byte) || (byte >= 0x80)){
+                        word += static_cast<char>(std::tolower(byte));
+                }
+                else{
+                        finish();
+                }
+
+                if(words.size() >= RELEVANCE_MAX_TERMS){
+                        return words;
+                }
+        }
+
+        finish();
+        return words;
+}
@@ -0,0 +1,46 @@
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _RELEVANCE_MODEL_H_
+#define _RELEVANCE_MODEL_H_
+
+#define RELEVANCE_LEARNING_RATE 0.1
+#define RELEVANCE_MAX_TERMS 16
+#define RELEVANCE_MIN_WEIGHT 0.001
+
+struct PostData;
+
+enum class Reaction{OPENED, SAVED, READ, SKIPPED};
+
+// Learns which feeds and title words get posts read. A post's score is the
+// log-odds of it being opened under a logistic model; every reaction to a
+// post moves the weights of its feed and words by one gradient step, so
+// the model keeps up without being retrained. Safe to use from any thread.
+class RelevanceModel{
+        public:
+                explicit RelevanceModel(const std::filesystem::path& path);
+                // A missing file leaves the model empty; both throw on I/O or parse errors.
+                void load();
+                void save() const;
+                // Posts get their features when first scored; scoring again only sums weights.
+                void score(std::vector<PostData>& posts);
+                void learn(const PostData& post, Reaction reaction);
+        private:
+                mutable std::mutex mutex;
+                std::filesystem::path path;
+                double bias{};
+                // Feeds and title words by id. Feed ids contain a slash, which
+                // words never do, so both share the table.
+                std::unordered_map<std::string, unsigned int> featureIds;
+                std::vector<std::string> featureNames;
+                std::vector<double> weights;
+                unsigned int intern(const std::string& name);
+                std::vector<unsigned int> featuresOf(const PostData& post, const std::vector<std::string>& words);
+                double scoreLocked(const PostData& post, const std::vector<unsigned int>& features) const;
+                static std::vector<std::string> termsOf(const std::string& title);
+};
+
+#endif
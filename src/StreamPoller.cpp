@@ -0,0 +1,68 @@
+#include <algorithm>
+
+#include "StreamPoller.h"
+
+static bool isAggregate(const std::string& id){
+        const auto all = std::string{"/category/global.all"};
+        return (id.length() >= all.length()) && (id.compare(id.length() - all.length(), all.length(), all) == 0);
+}
+
+StreamPoller::StreamPoller(Clock::time_point now):
+        lastPoll{now},
+        lastInput{now}{
+}
+void StreamPoller::recordInput(Clock::time_point now){
+        lastInput = now;
+}
+// Until some stream other than "All" is known, poll at the shortest interval.
+bool StreamPoller::due(Clock::time_point now) const{
+        auto paced = false;
+        for(const auto& [id, stream] : streams){
+                if(isAggregate(id)){
+                        continue;
+                }
+
+                if(now >= stream.polled + effective(stream.interval, now)){
+                        return true;
+                }
+
+                paced = true;
+        }
+
+        return !paced && (now >= lastPoll + effective(std::chrono::seconds(POLL_MIN_SECONDS), now));
+}
+// A stream is new when its newest entry got newer; the count alone can stay
+// the same when entries are read while others arrive.
+std::vector<std::string> StreamPoller::update(const std::map<std::string, UnreadCount>& counts, Clock::time_point now){
+        std::vector<std::string> changed;
+        for(const auto& [id, count] : counts){
+                const auto known = streams.find(id);
+                if(known == streams.end()){
+                        streams[id] = Stream{count, std::chrono::seconds(POLL_MIN_SECONDS), now};
+                        continue;
+                }
+
+                auto& stream = known->second;
+                const auto wasDue = now >= stream.polled + effective(stream.interval, now);
+                if((count.updated > stream.last.updated) || (count.count > stream.last.count)){
+                        changed.push_back(id);
+                        stream.interval = std::max(stream.interval / 2, std::chrono::seconds(POLL_MIN_SECONDS));
+                }
+                else if(wasDue){
+                        stream.interval = std::min(stream.interval * 2, std::chrono::seconds(POLL_MAX_SECONDS));
+                }
+
+                stream.last = count;
+                stream.polled = now;
+        }
+
+        lastPoll = now;
+        return changed;
+}
+StreamPoller::Clock::duration StreamPoller::effective(std::chrono::seconds interval, Clock::time_point now) const{
+        if(now - lastInput >= std::chrono::seconds(POLL_IDLE_SECONDS)){
+                return interval * POLL_IDLE_FACTOR;
+        }
+
+        return interval;
+}
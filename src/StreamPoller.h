@@ -0,0 +1,42 @@
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef _STREAM_POLLER_H_
+#define _STREAM_POLLER_H_
+
+#include "FeedlyProvider.h"
+
+#define POLL_MIN_SECONDS 60
+#define POLL_MAX_SECONDS 900
+#define POLL_IDLE_SECONDS 300
+#define POLL_IDLE_FACTOR 4
+
+// Decides when to look for new entries through the unread counts. Every
+// stream has its own interval, halved after new entries showed up in it
+// and doubled after a poll that found none, within POLL_MIN_SECONDS and
+// POLL_MAX_SECONDS. Without input for POLL_IDLE_SECONDS all intervals
+// are POLL_IDLE_FACTOR times longer. "All" gets new entries whenever any
+// stream does, so its new entries are reported but it doesn't set the pace.
+class StreamPoller{
+        public:
+                using Clock = std::chrono::steady_clock;
+                explicit StreamPoller(Clock::time_point now);
+                void recordInput(Clock::time_point now);
+                bool due(Clock::time_point now) const;
+                // Take over the counts of a poll and return the streams with new entries.
+                std::vector<std::string> update(const std::map<std::string, UnreadCount>& counts, Clock::time_point now);
+        private:
+                struct Stream{
+                        UnreadCount last;
+                        std::chrono::seconds interval{POLL_MIN_SECONDS};
+                        Clock::time_point polled;
+                };
+                std::map<std::string, Stream> streams;
+                Clock::time_point lastPoll;
+                Clock::time_point lastInput;
+                Clock::duration effective(std::chrono::seconds interval, Clock::time_point now) const;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include <unistd.h>
+
+#include <json/json.h>
+
+#include "Tracer.h"
+
+static unsigned int currentThreadId(){
+        static std::atomic<unsigned int> nextId{1};
+        thread_local const auto id = nextId++;
+        return id;
+}
+
+// The file is a JSON array of events. The trace viewers accept it without
+// the closing bracket, so a capture cut short by a crash still loads.
+void Tracer::start(const std::filesystem::path& path){
+        std::lock_guard lock(mutex);
+        output = std::ofstream(path);
+        output << "[\n";
+        firstEvent = true;
+        origin = std::chrono::steady_clock::now();
+        events.clear();
+        events.reserve(TRACE_FLUSH_EVENTS);
+        active = true;
+}
+void Tracer::stop(){
+        if(!active.exchange(false)){
+                return;
+        }
+
+        std::lock_guard lock(mutex);
+        flush();
+        output << "\n]\n";
+        output.close();
+}
+// Append the recorded events to the file; the mutex must be held.
+void Tracer::flush(){
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "";
+        const auto pid = static_cast<Json::Int>(getpid());
+        for(const auto& event : events){
+                Json::Value entry;
+                entry["name"] = event.name;
+                entry["cat"] = "feednix";
+                entry["ph"] = "X";
+                entry["ts"] = static_cast<Json::Int64>(event.ts);
+                entry["dur"] = static_cast<Json::Int64>(event.dur);
+                entry["pid"] = pid;
+                entry["tid"] = event.tid;
+                if(!event.detail.empty()){
+                        entry["args"]["detail"] = event.detail;
+                }
+
+                output << (firstEvent ? "" : ",\n") << Json::writeString(builder, entry);
+                firstEvent = false;
+        }
+
+        output.flush();
+        events.clear();
+}
+void Tracer::record(const char* name, std::string&& detail,
+                std::chrono::steady_clock::time_point begin,
+                std::chrono::steady_clock::time_point end){
+        using std::chrono::microseconds;
+        using std::chrono::duration_cast;
+
+        const auto tid = currentThreadId();
+
+        std::lock_guard lock(mutex);
+        if(!active){
+                return;
+        }
+
+        events.push_back({
+                name,
+                std::move(detail),
+                duration_cast<microseconds>(begin - origin).count(),
+                duration_cast<microseconds>(end - begin).count(),
+                tid});
+        if(events.size() >= TRACE_FLUSH_EVENTS){
+                flush();
+        }
+}
+
+TraceSpan::TraceSpan(const char* name, const std::string& detail):
+        name{name}{
+        if(Tracer::enabled()){
+                this->detail = detail;
+                begin = std::chrono::steady_clock::now();
+        }
+}
+TraceSpan::~TraceSpan(){
+        if(begin != std::chrono::steady_clock::time_point{}){
+                Tracer::record(name, std::move(detail), begin, std::chrono::steady_clock::now());
+        }
+}
@@ -0,0 +1,57 @@
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef _TRACER_H_
+#define _TRACER_H_
+
+#define TRACE_FLUSH_EVENTS 4096
+
+// Records timed spans and writes them in the Chrome trace-event format,
+// which can be loaded into Perfetto or chrome://tracing. Events are kept
+// in memory and appended to the file TRACE_FLUSH_EVENTS at a time.
+class Tracer{
+        public:
+                static void start(const std::filesystem::path& path);
+                static void stop();
+                static bool enabled(){
+                        return active.load(std::memory_order_relaxed);
+                }
+                static void record(const char* name, std::string&& detail,
+                                std::chrono::steady_clock::time_point begin,
+                                std::chrono::steady_clock::time_point end);
+        private:
+                struct Event{
+                        const char* name;
+                        std::string detail;
+                        long long ts;
+                        long long dur;
+                        unsigned int tid;
+                };
+                static inline std::atomic<bool> active{false};
+                static inline std::mutex mutex;
+                static inline std::vector<Event> events;
+                static inline std::ofstream output;
+                static inline bool firstEvent{true};
+                static inline std::chrono::steady_clock::time_point origin;
+                static void flush();
+};
+
+// Scoped span. It costs a single relaxed load when tracing is off.
+class TraceSpan{
+        public:
+                explicit TraceSpan(const char* name, const std::string& detail = std::string());
+                TraceSpan(const TraceSpan&) = delete;
+                TraceSpan& operator=(const TraceSpan&) = delete;
+                ~TraceSpan();
+        private:
+                const char* name;
+                std::string detail;
+                std::chrono::steady_clock::time_point begin{};
+};
+
+#endif
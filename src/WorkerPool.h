@@ -0,0 +1,92 @@
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+
+// A fixed set of threads running submitted tasks in FIFO order.
+class WorkerPool{
+        public:
+                WorkerPool(size_t threadCount);
+                WorkerPool(const WorkerPool&) = delete;
+                WorkerPool& operator=(const WorkerPool&) = delete;
+                ~WorkerPool();
+
+                template<typename Task>
+                auto submit(Task&& task) -> std::future<std::invoke_result_t<Task>>{
+                        using Result = std::invoke_result_t<Task>;
+
+                        // std::function needs a copyable target, hence the shared_ptr.
+                        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+                        auto future = packaged->get_future();
+                        {
+                                std::lock_guard lock(mutex);
+                                if(stopping){
+                                        throw std::runtime_error("The worker pool has been shut down");
+                                }
+
+                                queue.emplace_back([packaged]{ (*packaged)(); });
+                        }
+
+                        available.notify_one();
+                        return future;
+                }
+                void shutdown();
+        private:
+                std::vector<std::thread> threads;
+                std::deque<std::function<void()>> queue;
+                std::mutex mutex;
+                std::condition_variable available;
+                bool stopping{};
+                void run();
+};
+
+inline WorkerPool::WorkerPool(size_t threadCount){
+        for(size_t i = 0; i < threadCount; i++){
+                threads.emplace_back(&WorkerPool::run, this);
+        }
+}
+inline WorkerPool::~WorkerPool(){
+        shutdown();
+}
+// Finish the queued tasks and join the threads.
+inline void WorkerPool::shutdown(){
+        {
+                std::lock_guard lock(mutex);
+                stopping = true;
+        }
+
+        available.notify_all();
+        for(auto& thread : threads){
+                if(thread.joinable()){
+                        thread.join();
+                }
+        }
+}
+inline void WorkerPool::run(){
+        while(true){
+                std::function<void()> task;
+                {
+                        std::unique_lock lock(mutex);
+                        available.wait(lock, [this]{ return stopping || !queue.empty(); });
+                        if(queue.empty()){
+                                return;
+                        }
+
+                        task = std::move(queue.front());
+                        queue.pop_front();
+                }
+
+                task();
+        }
+}
+
+#endif
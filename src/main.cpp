@@ -1,6 +1,7 @@
 #include <filesystem>
 #include <iostream>
 #include <string.h>
+#include <pthread.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -8,6 +9,8 @@
 #include <stdio.h>
 
 #include "CursesProvider.h"
+#include "Logger.h"
+#include "Tracer.h"
 
 namespace fs = std::filesystem;
 
@@ -17,6 +20,9 @@ static fs::path TMPDIR;
 void atExitFunction(){
         auto errorCode = std::error_code{};
 
+        Tracer::stop();
+        Logger::stop();
+
         // Remove $TMPDIR/feednix.XXXXXX.
         if(!TMPDIR.empty()){
                 fs::remove_all(TMPDIR, errorCode);
@@ -34,10 +40,26 @@ void atExitFunction(){
         }
 }
 
+// Only async-signal-safe calls here: the orderly shutdown is left to the
+// interface returning from its loop, and a crash only dumps the last events.
 void sighandler(int signum){
-        atExitFunction();
+        const auto stop = (signum == SIGINT) || (signum == SIGTERM);
+        if(stop && CursesProvider::requestStop()){
+                return;
+        }
+
+        if(!stop){
+                Logger::dumpCrash(signum);
+        }
+
+        // Removed only while empty, as it is until the interface previews a post.
+        if(!TMPDIR.empty()){
+                rmdir(TMPDIR.c_str());
+        }
+
+        // Die of the signal, for the exit status and the core dump.
         signal(signum, SIG_DFL);
-        kill(getpid(), signum);
+        raise(signum);
 }
 
 void printUsage();
@@ -46,10 +68,14 @@ int main(int argc, char **argv){
         signal(SIGINT, sighandler);
         signal(SIGTERM, sighandler);
         signal(SIGSEGV, sighandler);
+        signal(SIGBUS, sighandler);
+        signal(SIGFPE, sighandler);
+        signal(SIGABRT, sighandler);
         atexit(atExitFunction);
 
         bool verboseEnabled = false;
         bool changeTokens = false;
+        fs::path importPath;
 
         // Create ~/.config/feednix/config.json if it doesn't exist.
         const auto home_path = fs::path{HOME_PATH};
@@ -61,6 +87,15 @@ int main(int argc, char **argv){
                 fs::permissions(config_path, fs::perms::owner_read | fs::perms::owner_write);
         }
 
+        // Every thread inherits this mask, so SIGCHLD only reaches the
+        // ChildReaper's descriptor; see ChildReaper.h.
+        sigset_t childSignal;
+        sigemptyset(&childSignal);
+        sigaddset(&childSignal, SIGCHLD);
+        pthread_sigmask(SIG_BLOCK, &childSignal, NULL);
+
+        Logger::start(config_dir / "log.txt");
+
         const auto pathTemp = fs::temp_directory_path() / "feednix.XXXXXX";
         const auto& pathTempString = pathTemp.native();
         auto pathTempBuffer = std::vector(pathTempString.begin(), pathTempString.end());
@@ -69,6 +104,28 @@ int main(int argc, char **argv){
 
         if(argc >= 2){
                 for(int i = 1; i < argc; ++i){
+                        if(strcmp(argv[i], "--trace") == 0){
+                                if(i + 1 >= argc){
+                                        printUsage();
+                                        std::cerr << "ERROR: Option '--trace' requires a file name" << std::endl;
+                                        exit(EXIT_FAILURE);
+                                }
+
+                                Tracer::start(fs::absolute(argv[++i]));
+                                continue;
+                        }
+
+                        if(strcmp(argv[i], "--import-opml") == 0){
+                                if(i + 1 >= argc){
+                                        printUsage();
+                                        std::cerr << "ERROR: Option '--import-opml' requires a file name" << std::endl;
+                                        exit(EXIT_FAILURE);
+                                }
+
+                                importPath = fs::absolute(argv[++i]);
+                                continue;
+                        }
+
                         if(argv[i][0] == '-' && argv[i][1] == 'h' && strlen(argv[1]) <= 2){
                                 printUsage();
                                 exit(EXIT_SUCCESS);
@@ -87,6 +144,28 @@ int main(int argc, char **argv){
                 }
         }
 
+        // Importing runs without the interface; the result is in log.txt.
+        if(!importPath.empty()){
+                auto feedly = FeedlyProvider();
+                feedly.setVerbose(verboseEnabled);
+                feedly.setChangeTokensFlag(changeTokens);
+                feedly.authenticateUser();
+
+                auto exitCode = EXIT_SUCCESS;
+                try{
+                        if(feedly.importOpml(importPath).failed > 0){
+                                exitCode = EXIT_FAILURE;
+                        }
+                }
+                catch(const std::exception& e){
+                        std::cerr << "ERROR: " << e.what() << std::endl;
+                        exitCode = EXIT_FAILURE;
+                }
+
+                feedly.curl_cleanup();
+                exit(exitCode);
+        }
+
         auto curses = CursesProvider(TMPDIR, verboseEnabled, changeTokens);
         curses.init();
         curses.control();
@@ -96,7 +175,7 @@ int main(int argc, char **argv){
 void printUsage(){
         std::cout << "Usage: feednix [OPTIONS]" << std::endl;
         std::cout << "  An ncurses-based console client for Feedly written in C++" << std::endl;
-        std::cout << "\n Options:\n  -h        Display this help and exit\n  -v        Set curl to output in verbose mode during login" << std::endl;
+        std::cout << "\n Options:\n  -h        Display this help and exit\n  -v        Set curl to output in verbose mode during login\n  --trace <file>\n            Write timed spans to <file> in the Chrome trace-event format\n  --import-opml <file>\n            Subscribe to the feeds listed in the OPML <file> and exit" << std::endl;
         std::cout << "\n Config:\n   Feednix uses a config file to set colors and\n   and the amount of posts to be retrived per\n   request." << std::endl;
         std::cout << "\n   This file can be found and must be placed in:\n     $HOME/.config/feednix\n   A sample config can be found in /etc/feednix" << std::endl;
         std::cout << "\n Author:\n   Copyright Jorge Martinez Hernandez <jorgemartinezhernandez@gmail.com>\n   Licensing information can be found in the source code" << std::endl;